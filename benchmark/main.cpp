@@ -0,0 +1,1107 @@
+//
+// Project: SmartMap
+// File: main.cpp
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "SmartMap.hpp"
+#include "ConcurrentSmartMap.hpp"
+#include "MappedSmartMap.hpp"
+#include "SharedSmartMap.hpp"
+#include "StaticSmartMap.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <string>
+#include <unordered_map>
+#include <random>
+#include <memory_resource>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <sstream>
+
+
+// Object type using the stable-address chunked storage
+struct ChunkedInt {
+    int value;
+};
+
+template <>
+struct SmartMap::StorageTraits<ChunkedInt> {
+    static constexpr std::size_t chunkSize = 4096;
+};
+
+// Object types using the default vector storage with eager and lazy Pointer rebinding
+struct EagerInt {
+    int value;
+};
+
+struct LazyInt {
+    int value;
+};
+
+template <>
+struct SmartMap::PointerTraits<LazyInt> {
+    static constexpr bool lazyRebinding = true;
+};
+
+// Trivially copyable object types using the vector and the chunked storage
+struct VectorPod {
+    float x, y, z, w;
+};
+
+struct ChunkedPod {
+    float x, y, z, w;
+};
+
+template <>
+struct SmartMap::StorageTraits<ChunkedPod> {
+    static constexpr std::size_t chunkSize = 4096;
+};
+
+
+// Measure average time in nanoseconds of a single operation, f performs nOps operations
+template <typename F>
+double nsPerOp(std::size_t nOps, F&& f)
+{
+    auto begin = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end-begin).count() / nOps;
+}
+
+// Insert n new keys to an empty map
+double benchmarkInsert(std::size_t n)
+{
+    SmartMap map;
+    return nsPerOp(n, [&](){
+        for (std::size_t i=0; i<n; ++i)
+            *map.getPointer<int, std::size_t>(i) = (int)i;
+    });
+}
+
+// Insert n new keys to an empty map backed by a monotonic arena, including
+// destruction of the map and the release of the arena
+double benchmarkArenaInsert(std::size_t n)
+{
+    return nsPerOp(n, [&](){
+        std::pmr::monotonic_buffer_resource arena;
+        SmartMap map(&arena);
+        for (std::size_t i=0; i<n; ++i)
+            *map.getPointer<int, std::size_t>(i) = (int)i;
+    });
+}
+
+// Copy pointers while n pointers are alive
+double benchmarkPointerCopy(std::size_t n, std::size_t nCopies)
+{
+    SmartMap map;
+    std::vector<SmartMap::Pointer<int>> pointers;
+    pointers.reserve(n);
+    for (std::size_t i=0; i<n; ++i)
+        pointers.push_back(map.getPointer<int, std::size_t>(i));
+
+    int sum = 0;
+    double t = nsPerOp(nCopies, [&](){
+        for (std::size_t i=0; i<nCopies; ++i) {
+            auto copy = pointers[i % n];
+            sum += *copy;
+        }
+    });
+
+    // Prevent the loop from being optimized out
+    if (sum == -1)
+        printf("\n");
+
+    return t;
+}
+
+// Copy views while n pointers are alive, same access pattern as benchmarkPointerCopy
+double benchmarkViewCopy(std::size_t n, std::size_t nCopies)
+{
+    SmartMap map;
+    std::vector<SmartMap::Pointer<int>> pointers;
+    pointers.reserve(n);
+    for (std::size_t i=0; i<n; ++i)
+        pointers.push_back(map.getPointer<int, std::size_t>(i));
+    std::vector<SmartMap::PointerView<int>> views(pointers.begin(), pointers.end());
+
+    int sum = 0;
+    double t = nsPerOp(nCopies, [&](){
+        for (std::size_t i=0; i<nCopies; ++i) {
+            auto copy = views[i % n];
+            sum += *copy;
+        }
+    });
+
+    // Prevent the loop from being optimized out
+    if (sum == -1)
+        printf("\n");
+
+    return t;
+}
+
+struct LoadResult {
+    double  loopNs;
+    double  reserveLoopNs;
+    double  batchNs;
+};
+
+// Load n new keys into an empty map while keeping the pointers to them, using
+// separate getPointer calls with and without reserve, and a single getPointers call
+LoadResult benchmarkLoad(std::size_t n)
+{
+    std::vector<std::size_t> keys(n);
+    for (std::size_t i=0; i<n; ++i)
+        keys[i] = i;
+
+    LoadResult result;
+    {
+        SmartMap map;
+        std::vector<SmartMap::Pointer<int>> pointers;
+        pointers.reserve(n);
+        result.loopNs = nsPerOp(n, [&](){
+            for (auto key : keys)
+                pointers.push_back(map.getPointer<int>(key));
+        });
+    }
+    {
+        SmartMap map;
+        std::vector<SmartMap::Pointer<int>> pointers;
+        pointers.reserve(n);
+        result.reserveLoopNs = nsPerOp(n, [&](){
+            map.reserve<int, std::size_t>(n);
+            for (auto key : keys)
+                pointers.push_back(map.getPointer<int>(key));
+        });
+    }
+    {
+        SmartMap map;
+        std::vector<SmartMap::Pointer<int>> pointers;
+        result.batchNs = nsPerOp(n, [&](){
+            pointers = map.getPointers<int, std::size_t>(keys);
+        });
+    }
+
+    return result;
+}
+
+struct StartupResult {
+    double  buildMs;
+    double  loadMs;
+    double  openUs;
+    double  mappedFindNs;
+};
+
+// Compare ways of getting a map of n keys into a process: inserting the keys,
+// loading a saved map and memory mapping a saved map
+StartupResult benchmarkStartup(std::size_t n)
+{
+    auto path = (std::filesystem::temp_directory_path() / "smartmap_benchmark.smap").string();
+
+    StartupResult result;
+    {
+        SmartMap map;
+        result.buildMs = nsPerOp(1, [&](){
+            for (std::size_t i=0; i<n; ++i)
+                *map.getPointer<int, std::size_t>(i) = (int)i;
+        }) / 1000000.0;
+        map.save(path);
+    }
+    {
+        result.loadMs = nsPerOp(1, [&](){
+            SmartMap map = SmartMap::load(path);
+            if (map.find<int, std::size_t>(n-1) == nullptr)
+                printf("\n");
+        }) / 1000000.0;
+    }
+    {
+        constexpr std::size_t nLookups = 1000000;
+        std::mt19937_64 rnd(15);
+        std::vector<std::size_t> keys(nLookups);
+        for (auto& key : keys)
+            key = rnd() % n;
+
+        long long sum = 0;
+        result.openUs = nsPerOp(1, [&](){
+            MappedSmartMap map(path);
+            sum += *map.find<int, std::size_t>(0);
+        }) / 1000.0;
+        MappedSmartMap map(path);
+        result.mappedFindNs = nsPerOp(nLookups, [&](){
+            for (auto key : keys)
+                sum += *map.find<int>(key);
+        });
+
+        // Prevent the loop from being optimized out
+        if (sum == 0)
+            printf("\n");
+    }
+    std::filesystem::remove(path);
+
+    return result;
+}
+
+struct SharedResult {
+    double  publishMs;
+    double  openUs;
+    double  findNs;
+    double  pointerNs;
+};
+
+// Publish a map of n keys into shared memory, open it and access it with
+// lookups and through pointers
+SharedResult benchmarkShared(std::size_t n)
+{
+    std::string name = "smartmap_benchmark";
+    SmartMap map;
+    for (std::size_t i=0; i<n; ++i)
+        *map.getPointer<int, std::size_t>(i) = (int)i;
+
+    SharedResult result;
+    result.publishMs = nsPerOp(1, [&](){
+        SharedSmartMap::publish(map, name);
+    }) / 1000000.0;
+
+    constexpr std::size_t nLookups = 1000000;
+    std::mt19937_64 rnd(17);
+    std::vector<std::size_t> keys(nLookups);
+    for (auto& key : keys)
+        key = rnd() % n;
+
+    long long sum = 0;
+    result.openUs = nsPerOp(1, [&](){
+        SharedSmartMap shared(name);
+        sum += *shared.find<int, std::size_t>(0);
+    }) / 1000.0;
+
+    SharedSmartMap shared(name);
+    result.findNs = nsPerOp(nLookups, [&](){
+        for (auto key : keys)
+            sum += *shared.find<int>(key);
+    });
+
+    std::vector<SharedSmartMap::Pointer<int>> pointers;
+    for (std::size_t i=0; i<std::min(n, (std::size_t)1000); ++i)
+        pointers.push_back(shared.getPointer<int>(i));
+    result.pointerNs = nsPerOp(nLookups, [&](){
+        for (auto key : keys)
+            sum += *pointers[key % pointers.size()];
+    });
+    SharedSmartMap::unlink(name);
+
+    // Prevent the loops from being optimized out
+    if (sum == 0)
+        printf("\n");
+
+    return result;
+}
+
+// Iterate over n objects with forEach and parallelForEach, returns ns per object for both
+std::pair<double, double> benchmarkForEach(std::size_t n)
+{
+    SmartMap map;
+    for (std::size_t i=0; i<n; ++i)
+        *map.getPointer<int, std::size_t>(i) = (int)i;
+
+    double tSerial = nsPerOp(n, [&](){
+        map.forEach<int>([](int& v){ v = v*3 + 1; });
+    });
+    double tParallel = nsPerOp(n, [&](){
+        map.parallelForEach<int>([](int& v){ v = v*3 + 1; });
+    });
+
+    // Prevent the loops from being optimized out
+    if (*map.getPointer<int, std::size_t>(0) == -1)
+        printf("\n");
+
+    return { tSerial, tParallel };
+}
+
+struct SnapshotResult {
+    double  copyUs;
+    double  snapshotUs;
+    double  detachUs;
+    double  pointerSnapshotUs;
+};
+
+// Copy a map with n entries, returns the latency in microseconds of a full
+// copy, a copy-on-write snapshot, the first write to the snapshot (which
+// detaches the data) and a snapshot of a map with a live Pointer to the type,
+// which can't share the data
+SnapshotResult benchmarkSnapshot(std::size_t n)
+{
+    SmartMap map;
+    for (std::size_t i=0; i<n; ++i)
+        *map.getPointer<int, std::size_t>(i) = (int)i;
+
+    SnapshotResult result;
+    result.copyUs = nsPerOp(1, [&](){ SmartMap copy(map); }) / 1000.0;
+    {
+        SmartMap snapshot;
+        result.snapshotUs = nsPerOp(1, [&](){ snapshot = map.snapshot(); }) / 1000.0;
+        result.detachUs = nsPerOp(1, [&](){ *snapshot.getPointer<int, std::size_t>(0) = 1; }) / 1000.0;
+    }
+    auto pointer = map.getPointer<int, std::size_t>(0);
+    result.pointerSnapshotUs = nsPerOp(1, [&](){ SmartMap snapshot = map.snapshot(); }) / 1000.0;
+
+    return result;
+}
+
+struct StaticResult {
+    double  insertNs;
+    double  findNs;
+    double  copyUs;
+    double  moveUs;
+};
+
+// Insert n keys for each of three object types, look them up, and copy and
+// move the map while 1000 Pointers of each type are held. Works with both
+// SmartMap and StaticSmartMap<int, double, ChunkedInt>.
+template <typename Map>
+StaticResult benchmarkTypedMap(std::size_t n)
+{
+    StaticResult result;
+    Map map;
+    result.insertNs = nsPerOp(3*n, [&](){
+        for (std::size_t i=0; i<n; ++i) {
+            *map.template getPointer<int, std::size_t>(i) = (int)i;
+            *map.template getPointer<double, std::size_t>(i) = (double)i;
+            (*map.template getPointer<ChunkedInt, std::size_t>(i)).value = (int)i;
+        }
+    });
+
+    double sum = 0.0;
+    result.findNs = nsPerOp(3*n, [&](){
+        for (std::size_t i=0; i<n; ++i) {
+            sum += *map.template find<int, std::size_t>(i);
+            sum += *map.template find<double, std::size_t>(i);
+            sum += map.template find<ChunkedInt, std::size_t>(i)->value;
+        }
+    });
+
+    // Moving doesn't visit the Pointers, so its time should not depend on n
+    std::vector<typename Map::template Pointer<int>> pointers1;
+    std::vector<typename Map::template Pointer<double>> pointers2;
+    std::vector<typename Map::template Pointer<ChunkedInt>> pointers3;
+    for (std::size_t i=0; i<n; ++i) {
+        pointers1.push_back(map.template getPointer<int, std::size_t>(i));
+        pointers2.push_back(map.template getPointer<double, std::size_t>(i));
+        pointers3.push_back(map.template getPointer<ChunkedInt, std::size_t>(i));
+    }
+    result.copyUs = nsPerOp(1, [&](){ Map copy(map); }) / 1000.0;
+    result.moveUs = nsPerOp(1, [&](){ Map moved(std::move(map)); map = std::move(moved); }) / 1000.0;
+
+    // Prevent the loops from being optimized out
+    if (sum == 0.0)
+        printf("\n");
+
+    return result;
+}
+
+// Generate string keys long enough to not fit in the small string buffer
+std::vector<std::string> stringKeys(std::size_t n)
+{
+    std::vector<std::string> keys;
+    keys.reserve(n);
+    for (std::size_t i=0; i<n; ++i)
+        keys.push_back("configuration/key/" + std::to_string(i));
+    return keys;
+}
+
+struct StringLookupResult {
+    double  stringNs; // std::string argument
+    double  temporaryNs; // const char* converted to a temporary std::string, the old path
+    double  literalNs; // const char* looked up without constructing a std::string
+};
+
+// Look up existing std::string keys with std::string and string literal
+// (const char*) arguments
+StringLookupResult benchmarkStringLookup(std::size_t n, std::size_t nLookups)
+{
+    SmartMap map;
+    auto keys = stringKeys(n);
+    for (auto& key : keys)
+        *map.getPointer<int, std::string>(key) = 1;
+
+    // Best of 5 repetitions to reduce noise
+    int sum = 0;
+    StringLookupResult result{ 1e9, 1e9, 1e9 };
+    for (int r=0; r<5; ++r) {
+        result.stringNs = std::min(result.stringNs, nsPerOp(nLookups, [&](){
+            for (std::size_t i=0; i<nLookups; ++i)
+                sum += *map.getPointer<int, std::string>(keys[i % n]);
+        }));
+        result.temporaryNs = std::min(result.temporaryNs, nsPerOp(nLookups, [&](){
+            for (std::size_t i=0; i<nLookups; ++i)
+                sum += *map.getPointer<int, std::string>(std::string(keys[i % n].c_str()));
+        }));
+        result.literalNs = std::min(result.literalNs, nsPerOp(nLookups, [&](){
+            for (std::size_t i=0; i<nLookups; ++i)
+                sum += *map.getPointer<int>(keys[i % n].c_str());
+        }));
+    }
+
+    // Prevent the loops from being optimized out
+    if (sum == -1)
+        printf("\n");
+
+    return result;
+}
+
+// Results of the hot path benchmarks, the same operations are measured for
+// SmartMap and for the std::unordered_map<K, std::unique_ptr<T>> baseline
+struct HotPathResult {
+    double  hitNs; // getPointer of an existing key
+    double  missNs; // getPointer of a new key
+    double  handleNs; // copy, move and destruction of a handle to an object
+    double  growthNs; // getPointer of a new key while a handle to every object is alive
+    double  copyUs; // deep copy of the whole map
+    double  moveUs; // move of the whole map and back
+    double  mixedNs; // getPointer of existing keys alternating between integer and string keys
+};
+
+template <typename F>
+double bestNsPerOp(std::size_t nOps, F&& f)
+{
+    // Best of 5 repetitions to reduce noise
+    double t = 1e9;
+    for (int r=0; r<5; ++r)
+        t = std::min(t, nsPerOp(nOps, f));
+    return t;
+}
+
+HotPathResult benchmarkHotPaths(std::size_t n, std::size_t nOps)
+{
+    HotPathResult result;
+    std::vector<std::size_t> keys(n);
+    for (std::size_t i=0; i<n; ++i)
+        keys[i] = i;
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(n));
+    auto sKeys = stringKeys(n);
+
+    SmartMap map;
+    int sum = 0;
+    result.missNs = nsPerOp(n, [&](){
+        for (std::size_t i=0; i<n; ++i)
+            *map.getPointer<int, std::size_t>(keys[i]) = (int)i;
+    });
+    result.hitNs = bestNsPerOp(nOps, [&](){
+        for (std::size_t i=0; i<nOps; ++i)
+            sum += *map.getPointer<int, std::size_t>(keys[i % n]);
+    });
+
+    std::vector<SmartMap::Pointer<int>> pointers;
+    pointers.reserve(n);
+    for (std::size_t i=0; i<n; ++i)
+        pointers.push_back(map.getPointer<int, std::size_t>(i));
+    result.handleNs = bestNsPerOp(nOps, [&](){
+        for (std::size_t i=0; i<nOps; ++i) {
+            auto copy = pointers[i % n];
+            auto moved = std::move(copy);
+            sum += *moved;
+        }
+    });
+
+    // The copy is deep, like the one of the baseline
+    result.copyUs = nsPerOp(1, [&](){ SmartMap copy(map); }) / 1000.0;
+    result.moveUs = nsPerOp(1, [&](){ SmartMap moved(std::move(map)); map = std::move(moved); }) / 1000.0;
+    pointers.clear();
+
+    {
+        SmartMap growthMap;
+        std::vector<SmartMap::Pointer<int>> growthPointers;
+        growthPointers.reserve(n);
+        result.growthNs = nsPerOp(n, [&](){
+            for (std::size_t i=0; i<n; ++i)
+                growthPointers.push_back(growthMap.getPointer<int, std::size_t>(keys[i]));
+        });
+    }
+
+    for (auto& key : sKeys)
+        *map.getPointer<int, std::string>(key) = 1;
+    result.mixedNs = bestNsPerOp(nOps, [&](){
+        for (std::size_t i=0; i<nOps; i+=2) {
+            sum += *map.getPointer<int, std::size_t>(keys[i % n]);
+            sum += *map.getPointer<int, std::string>(sKeys[(i+1) % n]);
+        }
+    });
+
+    // Prevent the loops from being optimized out
+    if (sum == -1)
+        printf("\n");
+
+    return result;
+}
+
+HotPathResult benchmarkHotPathsBaseline(std::size_t n, std::size_t nOps)
+{
+    using Map = std::unordered_map<std::size_t, std::unique_ptr<int>>;
+    using StringMap = std::unordered_map<std::string, std::unique_ptr<int>>;
+
+    // Equivalent of getPointer: default construct the object in case the key doesn't exist
+    auto get = [](auto& m, const auto& key) -> int* {
+        auto& p = m[key];
+        if (!p)
+            p = std::make_unique<int>();
+        return p.get();
+    };
+
+    HotPathResult result;
+    std::vector<std::size_t> keys(n);
+    for (std::size_t i=0; i<n; ++i)
+        keys[i] = i;
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(n));
+    auto sKeys = stringKeys(n);
+
+    Map map;
+    int sum = 0;
+    result.missNs = nsPerOp(n, [&](){
+        for (std::size_t i=0; i<n; ++i)
+            *get(map, keys[i]) = (int)i;
+    });
+    result.hitNs = bestNsPerOp(nOps, [&](){
+        for (std::size_t i=0; i<nOps; ++i)
+            sum += *get(map, keys[i % n]);
+    });
+
+    // Raw pointers are the handles, they stay valid as the objects don't move
+    std::vector<int*> pointers;
+    pointers.reserve(n);
+    for (std::size_t i=0; i<n; ++i)
+        pointers.push_back(get(map, i));
+    result.handleNs = bestNsPerOp(nOps, [&](){
+        for (std::size_t i=0; i<nOps; ++i) {
+            auto* copy = pointers[i % n];
+            auto* moved = std::move(copy);
+            sum += *moved;
+        }
+    });
+
+    result.copyUs = nsPerOp(1, [&](){
+        Map copy;
+        copy.reserve(map.size());
+        for (auto& [key, p] : map)
+            copy.emplace(key, std::make_unique<int>(*p));
+    }) / 1000.0;
+    result.moveUs = nsPerOp(1, [&](){ Map moved(std::move(map)); map = std::move(moved); }) / 1000.0;
+    pointers.clear();
+
+    {
+        Map growthMap;
+        std::vector<int*> growthPointers;
+        growthPointers.reserve(n);
+        result.growthNs = nsPerOp(n, [&](){
+            for (std::size_t i=0; i<n; ++i)
+                growthPointers.push_back(get(growthMap, keys[i]));
+        });
+    }
+
+    StringMap stringMap;
+    for (auto& key : sKeys)
+        *get(stringMap, key) = 1;
+    result.mixedNs = bestNsPerOp(nOps, [&](){
+        for (std::size_t i=0; i<nOps; i+=2) {
+            sum += *get(map, keys[i % n]);
+            sum += *get(stringMap, sKeys[(i+1) % n]);
+        }
+    });
+
+    // Prevent the loops from being optimized out
+    if (sum == -1)
+        printf("\n");
+
+    return result;
+}
+
+// Result written to the JSON report
+struct JsonResult {
+    std::string name;
+    std::size_t iterations;
+    double      ns;
+};
+
+// Write the results in the JSON format of Google Benchmark, so that its tools
+// (e.g. compare.py) can be used for tracking regressions
+bool writeJson(const char* path, const std::vector<JsonResult>& results)
+{
+    FILE* f = std::fopen(path, "w");
+    if (f == nullptr)
+        return false;
+
+#ifdef NDEBUG
+    const char* buildType = "release";
+#else
+    const char* buildType = "debug";
+#endif
+
+    std::fprintf(f, "{\n  \"context\": {\n");
+    std::fprintf(f, "    \"executable\": \"SmartMapBenchmark\",\n");
+    std::fprintf(f, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+    std::fprintf(f, "    \"library_build_type\": \"%s\"\n", buildType);
+    std::fprintf(f, "  },\n  \"benchmarks\": [");
+    for (std::size_t i=0; i<results.size(); ++i) {
+        auto& r = results[i];
+        std::fprintf(f, "%s\n    {\"name\": \"%s\", \"run_name\": \"%s\", \"run_type\": \"iteration\", "
+            "\"iterations\": %zu, \"real_time\": %.3f, \"cpu_time\": %.3f, \"time_unit\": \"ns\"}",
+            i > 0 ? "," : "", r.name.c_str(), r.name.c_str(), r.iterations, r.ns, r.ns);
+    }
+    std::fprintf(f, "\n  ]\n}\n");
+
+    return std::fclose(f) == 0;
+}
+
+// Allocator counting the allocated bytes, used for measuring memory usage of std::unordered_map
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    std::size_t* bytes;
+
+    explicit CountingAllocator(std::size_t* bytes) : bytes(bytes) {}
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& other) : bytes(other.bytes) {}
+
+    T* allocate(std::size_t n)
+    {
+        *bytes += n*sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        *bytes -= n*sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U>& other) const { return bytes == other.bytes; }
+    template <typename U>
+    bool operator!=(const CountingAllocator<U>& other) const { return bytes != other.bytes; }
+};
+
+struct IndexResult {
+    double  flatBytes;
+    double  nodeBytes;
+    double  flatInsertNs;
+    double  nodeInsertNs;
+    double  flatNs;
+    double  nodeNs;
+};
+
+// Compare FlatHashMap against std::unordered_map as the key -> Id index: memory
+// per entry (excluding heap memory owned by the keys), insertion time and random
+// lookup latency
+template <typename K>
+IndexResult benchmarkIndex(const std::vector<K>& keys, std::size_t nLookups)
+{
+    using Hash = typename SmartMap::KeyTraits<K>::Hash;
+    using Equal = typename SmartMap::KeyTraits<K>::Equal;
+    using Value = std::pair<const K, std::size_t>;
+
+    std::size_t nodeBytes = 0;
+    FlatHashMap<K, std::size_t, Hash, Equal> flat;
+    std::unordered_map<K, std::size_t, Hash, Equal, CountingAllocator<Value>> node(
+        0, Hash(), Equal(), CountingAllocator<Value>(&nodeBytes));
+
+    IndexResult result;
+    result.flatInsertNs = nsPerOp(keys.size(), [&](){
+        for (std::size_t i=0; i<keys.size(); ++i)
+            flat.try_emplace(keys[i], i);
+    });
+    result.nodeInsertNs = nsPerOp(keys.size(), [&](){
+        for (std::size_t i=0; i<keys.size(); ++i)
+            node.try_emplace(keys[i], i);
+    });
+
+    // Random lookup order so that consecutive lookups don't share cache lines
+    std::vector<std::size_t> order(nLookups);
+    std::mt19937_64 rng(1337);
+    for (auto& o : order)
+        o = rng() % keys.size();
+
+    std::size_t sum = 0;
+    result.flatBytes = (double)flat.capacity()*(1 + sizeof(typename decltype(flat)::value_type)) / keys.size();
+    result.nodeBytes = (double)nodeBytes / keys.size();
+    result.flatNs = nsPerOp(nLookups, [&](){
+        for (auto o : order)
+            sum += flat.find(keys[o])->second;
+    });
+    result.nodeNs = nsPerOp(nLookups, [&](){
+        for (auto o : order)
+            sum += node.find(keys[o])->second;
+    });
+
+    // Prevent the loops from being optimized out
+    if (sum == 1)
+        printf("\n");
+
+    return result;
+}
+
+// Insert n new keys while keeping pointers to all of them alive, returns the
+// worst-case latency of a single getPointer call in nanoseconds
+template <typename T>
+double benchmarkGrowthLatency(std::size_t n)
+{
+    SmartMap map;
+    std::vector<SmartMap::Pointer<T>> pointers;
+    pointers.reserve(n);
+
+    double maxLatency = 0.0;
+    for (std::size_t i=0; i<n; ++i) {
+        maxLatency = std::max(maxLatency, nsPerOp(1, [&](){
+            pointers.push_back(map.getPointer<T, std::size_t>(i));
+        }));
+    }
+
+    return maxLatency;
+}
+
+struct BatchLookupResult {
+    double  getPointerNs; // sequential getPointer
+    double  findNs; // sequential find
+    double  lookupNs; // batched lookup
+};
+
+// Resolve requests of nKeys random existing keys at once, returns ns per key
+BatchLookupResult benchmarkBatchLookup(std::size_t n, std::size_t nLookups)
+{
+    constexpr std::size_t nKeys = 32;
+    BatchLookupResult result;
+
+    std::mt19937_64 rng(n);
+    std::vector<std::size_t> keys(n);
+    for (auto& key : keys)
+        key = rng();
+    SmartMap map;
+    map.reserve<int, std::size_t>(n);
+    for (std::size_t i=0; i<n; ++i)
+        *map.getPointer<int, std::size_t>(keys[i]) = (int)i;
+
+    std::vector<std::size_t> requests(nLookups);
+    for (auto& key : requests)
+        key = keys[rng() % n];
+
+    int sum = 0;
+    result.getPointerNs = bestNsPerOp(nLookups, [&](){
+        for (std::size_t i=0; i<nLookups; ++i)
+            sum += *map.getPointer<int, std::size_t>(requests[i]);
+    });
+    result.findNs = bestNsPerOp(nLookups, [&](){
+        for (std::size_t i=0; i<nLookups; ++i)
+            sum += *map.find<int, std::size_t>(requests[i]);
+    });
+    std::vector<const int*> out(nKeys);
+    result.lookupNs = bestNsPerOp(nLookups, [&](){
+        for (std::size_t i=0; i+nKeys<=nLookups; i+=nKeys) {
+            map.lookup<int, std::size_t>(std::span<const std::size_t>(&requests[i], nKeys), out);
+            for (auto* o : out)
+                sum += *o;
+        }
+    });
+
+    // Prevent the loops from being optimized out
+    if (sum == -1)
+        printf("\n");
+
+    return result;
+}
+
+struct RebindingResult {
+    double  manyInsertNs; // insert while a Pointer to every object is held
+    double  manyDerefNs; // dereference each of the held Pointers once afterwards
+    double  fewDerefNs; // dereference of a few Pointers between insertions
+};
+
+// Workloads with many rarely dereferenced Pointers and few hot Pointers
+template <typename T>
+RebindingResult benchmarkRebinding(std::size_t n)
+{
+    RebindingResult result;
+    int sum = 0;
+
+    {
+        SmartMap map;
+        std::vector<SmartMap::Pointer<T>> pointers;
+        pointers.reserve(n);
+        result.manyInsertNs = nsPerOp(n, [&](){
+            for (std::size_t i=0; i<n; ++i)
+                pointers.push_back(map.getPointer<T, std::size_t>(i));
+        });
+        result.manyDerefNs = nsPerOp(n, [&](){
+            for (auto& p : pointers)
+                sum += (*p).value;
+        });
+    }
+
+    {
+        constexpr std::size_t nPointers = 16;
+        SmartMap map;
+        std::vector<SmartMap::Pointer<T>> pointers;
+        for (std::size_t i=0; i<nPointers; ++i)
+            pointers.push_back(map.getPointer<T, std::size_t>(i));
+
+        // Insertion time is included, measured separately by manyInsertNs
+        result.fewDerefNs = nsPerOp(n*nPointers, [&](){
+            for (std::size_t i=0; i<n; ++i) {
+                (*map.getPointer<T, std::size_t>(nPointers+i)).value = (int)i;
+                for (auto& p : pointers)
+                    sum += (*p).value;
+            }
+        });
+    }
+
+    // Prevent the loops from being optimized out
+    if (sum == -1)
+        printf("\n");
+
+    return result;
+}
+
+struct PodCopyResult {
+    double  copyMs; // deep copy into freshly allocated memory
+    double  warmCopyMs; // deep copy into memory that has been written before
+    double  loadMs; // load from a serialized stream
+};
+
+// Copy and load a map of n trivially copyable objects
+template <typename T>
+PodCopyResult benchmarkPodCopy(std::size_t n)
+{
+    PodCopyResult result;
+    SmartMap map;
+    for (std::size_t i=0; i<n; ++i)
+        (*map.getPointer<T, std::size_t>(i)).x = (float)i;
+    float sum = 0.0f;
+
+    result.copyMs = 1e-6 * bestNsPerOp(1, [&](){
+        SmartMap copy(map);
+        sum += copy.find<T, std::size_t>(n-1)->x;
+    });
+
+    // Freshly allocated memory is dominated by page faults, a pre-faulted
+    // arena shows the cost of the copy itself
+    std::vector<char> buffer(n*(sizeof(T)+64) + (1<<20), 1);
+    result.warmCopyMs = 1e-6 * bestNsPerOp(1, [&](){
+        std::pmr::monotonic_buffer_resource resource(buffer.data(), buffer.size());
+        SmartMap copy(map, &resource);
+        sum += copy.find<T, std::size_t>(n-1)->x;
+    });
+
+    std::stringstream stream;
+    map.save(stream);
+    auto data = stream.str();
+    result.loadMs = 1e-6 * bestNsPerOp(1, [&](){
+        std::istringstream in(data);
+        auto loaded = SmartMap::load(in);
+        sum += loaded.find<T, std::size_t>(n-1)->x;
+    });
+
+    // Prevent the loops from being optimized out
+    if (sum == -1.0f)
+        printf("\n");
+
+    return result;
+}
+
+// Look up existing keys of a map with n entries from nThreads threads at once,
+// returns the aggregate throughput in million lookups per second
+double benchmarkConcurrentLookup(std::size_t n, std::size_t nThreads, std::size_t nLookups)
+{
+    ConcurrentSmartMap map(64);
+    for (std::size_t i=0; i<n; ++i)
+        (*map.getPointer<ChunkedInt, std::size_t>(i)).value = (int)i;
+
+    std::vector<std::thread> threads;
+    std::vector<int> sums(nThreads, 0);
+    double t = nsPerOp(nLookups*nThreads, [&](){
+        for (std::size_t threadId=0; threadId<nThreads; ++threadId) {
+            threads.emplace_back([&, threadId](){
+                // Each thread starts walking the keys from a different position
+                std::size_t key = threadId;
+                int sum = 0;
+                for (std::size_t i=0; i<nLookups; ++i) {
+                    key = (key + 7919) % n;
+                    sum += (*map.getPointer<ChunkedInt, std::size_t>(key)).value;
+                }
+                sums[threadId] = sum;
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+    });
+
+    // Prevent the loop from being optimized out
+    if (std::find(sums.begin(), sums.end(), -1) != sums.end())
+        printf("\n");
+
+    return 1000.0 / t;
+}
+
+int main(int argc, char** argv)
+{
+#ifndef NDEBUG
+    printf("Warning: benchmark built without NDEBUG, use a release build for meaningful results\n");
+#endif
+
+    // Usage: SmartMapBenchmark [max entries] [--json report.json]. The report
+    // contains the hot path benchmarks.
+    std::size_t maxSize = 10000000;
+    const char* jsonPath = nullptr;
+    for (int i=1; i<argc; ++i) {
+        if (std::string_view(argv[i]) == "--json" && i+1 < argc)
+            jsonPath = argv[++i];
+        else
+            maxSize = std::strtoull(argv[i], nullptr, 10);
+    }
+    constexpr std::size_t nCopies = 1000000;
+
+    std::vector<JsonResult> jsonResults;
+    printf("%12s %10s %10s %10s %12s %12s %12s %12s %12s\n", "entries", "map", "hit ns", "miss ns",
+        "handle ns", "growth ns", "copy us", "move us", "mixed ns");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        auto report = [&](const char* map, const HotPathResult& r) {
+            printf("%12zu %10s %10.2f %10.2f %12.2f %12.2f %12.2f %12.2f %12.2f\n", n, map,
+                r.hitNs, r.missNs, r.handleNs, r.growthNs, r.copyUs, r.moveUs, r.mixedNs);
+
+            auto add = [&](const char* benchmark, std::size_t iterations, double ns) {
+                jsonResults.push_back({ std::string(map) + "/" + benchmark + "/" + std::to_string(n),
+                    iterations, ns });
+            };
+            add("getPointer_hit", nCopies, r.hitNs);
+            add("getPointer_miss", n, r.missNs);
+            add("handle_copy_move_destroy", nCopies, r.handleNs);
+            add("growth_with_live_handles", n, r.growthNs);
+            add("map_copy", 1, r.copyUs * 1000.0);
+            add("map_move", 1, r.moveUs * 1000.0);
+            add("getPointer_mixed_keys", nCopies, r.mixedNs);
+        };
+        report("SmartMap", benchmarkHotPaths(n, nCopies));
+        report("baseline", benchmarkHotPathsBaseline(n, nCopies));
+    }
+
+    if (jsonPath != nullptr && !writeJson(jsonPath, jsonResults)) {
+        fprintf(stderr, "Unable to write %s\n", jsonPath);
+        return 1;
+    }
+
+    printf("\n%12s %16s %20s %16s %16s\n", "entries", "insert ns/op", "arena insert ns/op",
+        "copy ns/op", "view copy ns/op");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        printf("%12zu %16.2f %20.2f %16.2f %16.2f\n", n, benchmarkInsert(n), benchmarkArenaInsert(n),
+            benchmarkPointerCopy(n, nCopies), benchmarkViewCopy(n, nCopies));
+    }
+
+    printf("\n%12s %16s %16s %16s\n", "entries", "load ns/key", "reserve ns/key", "batch ns/key");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        auto r = benchmarkLoad(n);
+        printf("%12zu %16.2f %16.2f %16.2f\n", n, r.loopNs, r.reserveLoopNs, r.batchNs);
+    }
+
+    printf("\n%12s %16s %16s %16s %20s\n", "entries", "copy us", "snapshot us", "detach us",
+        "Pointer snapshot us");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        auto r = benchmarkSnapshot(n);
+        printf("%12zu %16.2f %16.2f %16.2f %20.2f\n", n, r.copyUs, r.snapshotUs, r.detachUs,
+            r.pointerSnapshotUs);
+    }
+
+    printf("\n%12s %8s %16s %16s %16s %16s\n", "entries", "map", "insert ns/op", "find ns/op",
+        "copy us", "move x2 us");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        auto d = benchmarkTypedMap<SmartMap>(n);
+        auto s = benchmarkTypedMap<StaticSmartMap<int, double, ChunkedInt>>(n);
+        printf("%12zu %8s %16.2f %16.2f %16.2f %16.2f\n", n, "dynamic", d.insertNs, d.findNs, d.copyUs, d.moveUs);
+        printf("%12zu %8s %16.2f %16.2f %16.2f %16.2f\n", n, "static", s.insertNs, s.findNs, s.copyUs, s.moveUs);
+    }
+
+    printf("\n%12s %16s %16s %16s %16s\n", "entries", "build ms", "load ms", "map open us",
+        "mapped find ns");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        auto r = benchmarkStartup(n);
+        printf("%12zu %16.2f %16.2f %16.2f %16.2f\n", n, r.buildMs, r.loadMs, r.openUs, r.mappedFindNs);
+    }
+
+    printf("\n%12s %16s %16s %16s %16s\n", "entries", "publish ms", "shared open us",
+        "shared find ns", "shared ptr ns");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        auto r = benchmarkShared(n);
+        printf("%12zu %16.2f %16.2f %16.2f %16.2f\n", n, r.publishMs, r.openUs, r.findNs, r.pointerNs);
+    }
+
+    printf("\n%12s %16s %16s\n", "entries", "forEach ns/obj", "parallel ns/obj");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        auto t = benchmarkForEach(n);
+        printf("%12zu %16.2f %16.2f\n", n, t.first, t.second);
+    }
+
+    printf("\n%12s %20s %20s %20s\n", "entries", "vector max ns", "chunked max ns", "lazy max ns");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        printf("%12zu %20.0f %20.0f %20.0f\n", n,
+            benchmarkGrowthLatency<int>(n), benchmarkGrowthLatency<ChunkedInt>(n),
+            benchmarkGrowthLatency<LazyInt>(n));
+    }
+
+    printf("\n%12s %8s %20s %20s %20s\n", "entries", "pointers", "many insert ns/op",
+        "many deref ns/op", "few deref ns/op");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        auto e = benchmarkRebinding<EagerInt>(n);
+        auto l = benchmarkRebinding<LazyInt>(n);
+        printf("%12zu %8s %20.2f %20.2f %20.2f\n", n, "eager", e.manyInsertNs, e.manyDerefNs, e.fewDerefNs);
+        printf("%12zu %8s %20.2f %20.2f %20.2f\n", n, "lazy", l.manyInsertNs, l.manyDerefNs, l.fewDerefNs);
+    }
+
+    printf("\n%12s %20s %24s %20s\n", "entries", "std::string ns/op", "temp std::string ns/op",
+        "const char* ns/op");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        auto r = benchmarkStringLookup(n, nCopies);
+        printf("%12zu %20.2f %24.2f %20.2f\n", n, r.stringNs, r.temporaryNs, r.literalNs);
+    }
+
+    printf("\n%12s %20s %20s %20s\n", "entries", "getPointer ns/key", "find ns/key", "lookup ns/key");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        auto r = benchmarkBatchLookup(n, nCopies);
+        printf("%12zu %20.2f %20.2f %20.2f\n", n, r.getPointerNs, r.findNs, r.lookupNs);
+    }
+
+    printf("\n%12s %8s %16s %16s %16s\n", "entries", "storage", "POD copy ms", "warm copy ms",
+        "POD load ms");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        auto v = benchmarkPodCopy<VectorPod>(n);
+        auto c = benchmarkPodCopy<ChunkedPod>(n);
+        printf("%12zu %8s %16.2f %16.2f %16.2f\n", n, "vector", v.copyMs, v.warmCopyMs, v.loadMs);
+        printf("%12zu %8s %16.2f %16.2f %16.2f\n", n, "chunked", c.copyMs, c.warmCopyMs, c.loadMs);
+    }
+
+    printf("\n%12s %8s %12s %12s %14s %14s %12s %12s\n", "entries", "key", "flat B/key", "node B/key",
+        "flat insert ns", "node insert ns", "flat ns", "node ns");
+    for (std::size_t n=1000; n<=maxSize; n*=10) {
+        std::vector<std::size_t> intKeys(n);
+        std::mt19937_64 rng(n);
+        for (auto& key : intKeys)
+            key = rng();
+
+        auto r = benchmarkIndex(intKeys, nCopies);
+        printf("%12zu %8s %12.1f %12.1f %14.2f %14.2f %12.2f %12.2f\n", n, "size_t",
+            r.flatBytes, r.nodeBytes, r.flatInsertNs, r.nodeInsertNs, r.flatNs, r.nodeNs);
+        r = benchmarkIndex(stringKeys(n), nCopies);
+        printf("%12zu %8s %12.1f %12.1f %14.2f %14.2f %12.2f %12.2f\n", n, "string",
+            r.flatBytes, r.nodeBytes, r.flatInsertNs, r.nodeInsertNs, r.flatNs, r.nodeNs);
+    }
+
+    printf("\n%12s %20s (hardware threads: %u)\n", "threads", "lookups Mops/s",
+        std::thread::hardware_concurrency());
+    for (std::size_t nThreads=1; nThreads<=32; nThreads*=2)
+        printf("%12zu %20.2f\n", nThreads, benchmarkConcurrentLookup(100000, nThreads, 1000000));
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+//
+// Project: SmartMap
+// File: ChunkedVector.hpp
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef SMARTMAP_CHUNKEDVECTOR_HPP
+#define SMARTMAP_CHUNKEDVECTOR_HPP
+
+
+#include <vector>
+#include <memory>
+#include <memory_resource>
+#include <cstddef>
+#include <type_traits>
+
+
+// Sequence container storing its elements in fixed-size chunks. Unlike with
+// std::vector, growing the container never moves the existing elements, so
+// pointers and references to them stay valid until the element is destroyed.
+// Chunks are allocated with Allocator, following the allocator propagation
+// rules of the standard containers.
+template <typename T, std::size_t ChunkSize, typename Allocator = std::allocator<T>>
+class ChunkedVector {
+public:
+    static_assert(ChunkSize > 0, "ChunkSize must be nonzero");
+
+    using value_type = T;
+    using size_type = std::size_t;
+    using allocator_type = Allocator;
+
+    ChunkedVector() = default;
+    explicit ChunkedVector(const Allocator& allocator);
+
+    ChunkedVector(const ChunkedVector& other);
+    ChunkedVector(const ChunkedVector& other, const Allocator& allocator);
+    ChunkedVector(ChunkedVector&& other) noexcept;
+    ChunkedVector& operator=(const ChunkedVector& other);
+    ChunkedVector& operator=(ChunkedVector&& other) noexcept(
+        std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value ||
+        std::allocator_traits<Allocator>::is_always_equal::value);
+
+    ~ChunkedVector();
+
+    // Construct a new element to the end of the container
+    template <typename... Args>
+    T& emplace_back(Args&&... args);
+
+    // Destroy the last element, the chunk is kept allocated
+    void pop_back() noexcept;
+
+    // Destroy all elements and release the chunks
+    void clear() noexcept;
+
+    // Allocate chunks so that at least n elements fit without further allocation
+    void reserve(size_type n);
+
+    inline T& operator[](size_type i) __attribute__((always_inline));
+    inline const T& operator[](size_type i) const __attribute__((always_inline));
+
+    size_type size() const noexcept;
+    size_type capacity() const noexcept;
+    bool empty() const noexcept;
+
+    allocator_type get_allocator() const noexcept;
+
+private:
+    using AllocatorTraits = std::allocator_traits<Allocator>;
+    using ChunkAllocator = typename AllocatorTraits::template rebind_alloc<T*>;
+
+    // Elements can be copied with memcpy in case they are trivially copyable and
+    // the allocator doesn't customize their construction
+    static constexpr bool memcpyCopyable = std::is_trivially_copyable_v<T> &&
+        (std::is_same_v<Allocator, std::allocator<T>> ||
+        std::is_same_v<Allocator, std::pmr::polymorphic_allocator<T>>);
+
+    Allocator                       _allocator;
+    std::vector<T*, ChunkAllocator> _chunks{ChunkAllocator(_allocator)};
+    size_type                       _size = 0;
+
+    // Copy elements of other, which is required to be empty
+    void copyElements(const ChunkedVector& other);
+
+    void addChunk();
+
+    T* allocateChunk();
+    void deallocateChunk(T* chunk) noexcept;
+};
+
+
+#include "ChunkedVector.inl"
+
+
+#endif //SMARTMAP_CHUNKEDVECTOR_HPP
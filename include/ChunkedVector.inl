@@ -0,0 +1,230 @@
+//
+// Project: SmartMap
+// File: ChunkedVector.inl
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <utility>
+
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+ChunkedVector<T, ChunkSize, Allocator>::ChunkedVector(const Allocator& allocator) :
+    _allocator  (allocator),
+    _chunks     (ChunkAllocator(_allocator))
+{
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+ChunkedVector<T, ChunkSize, Allocator>::ChunkedVector(const ChunkedVector& other) :
+    ChunkedVector(other, AllocatorTraits::select_on_container_copy_construction(other._allocator))
+{
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+ChunkedVector<T, ChunkSize, Allocator>::ChunkedVector(const ChunkedVector& other, const Allocator& allocator) :
+    _allocator  (allocator),
+    _chunks     (ChunkAllocator(_allocator))
+{
+    try {
+        copyElements(other);
+    }
+    catch (...) {
+        // Destructor won't be called for partially constructed object
+        clear();
+        throw;
+    }
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+ChunkedVector<T, ChunkSize, Allocator>::ChunkedVector(ChunkedVector&& other) noexcept :
+    _allocator  (other._allocator),
+    _chunks     (std::move(other._chunks)),
+    _size       (other._size)
+{
+    other._chunks.clear();
+    other._size = 0;
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+ChunkedVector<T, ChunkSize, Allocator>&
+ChunkedVector<T, ChunkSize, Allocator>::operator=(const ChunkedVector& other)
+{
+    if (this == &other)
+        return *this;
+
+    clear();
+    if constexpr (AllocatorTraits::propagate_on_container_copy_assignment::value) {
+        _allocator = other._allocator;
+        _chunks = std::vector<T*, ChunkAllocator>(ChunkAllocator(_allocator));
+    }
+    copyElements(other);
+
+    return *this;
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+ChunkedVector<T, ChunkSize, Allocator>&
+ChunkedVector<T, ChunkSize, Allocator>::operator=(ChunkedVector&& other) noexcept(
+    std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value ||
+    std::allocator_traits<Allocator>::is_always_equal::value)
+{
+    if (this == &other)
+        return *this;
+
+    clear();
+
+    // Chunks can only be taken over if they can be deallocated with our allocator,
+    // otherwise the elements are moved one by one
+    if constexpr (!AllocatorTraits::propagate_on_container_move_assignment::value &&
+        !AllocatorTraits::is_always_equal::value) {
+        if (_allocator != other._allocator) {
+            reserve(other._size);
+            for (size_type i=0; i<other._size; ++i)
+                emplace_back(std::move(other[i]));
+            other.clear();
+            return *this;
+        }
+    }
+
+    if constexpr (AllocatorTraits::propagate_on_container_move_assignment::value)
+        _allocator = other._allocator;
+    _chunks = std::move(other._chunks);
+    _size = other._size;
+    other._chunks.clear();
+    other._size = 0;
+
+    return *this;
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+ChunkedVector<T, ChunkSize, Allocator>::~ChunkedVector()
+{
+    clear();
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+template <typename... Args>
+T& ChunkedVector<T, ChunkSize, Allocator>::emplace_back(Args&&... args)
+{
+    if (_size == capacity())
+        addChunk();
+
+    T* element = &(*this)[_size];
+    AllocatorTraits::construct(_allocator, element, std::forward<Args>(args)...);
+    ++_size;
+    return *element;
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+void ChunkedVector<T, ChunkSize, Allocator>::pop_back() noexcept
+{
+    --_size;
+    AllocatorTraits::destroy(_allocator, &(*this)[_size]);
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+void ChunkedVector<T, ChunkSize, Allocator>::clear() noexcept
+{
+    for (size_type i=0; i<_size; ++i)
+        AllocatorTraits::destroy(_allocator, &(*this)[i]);
+
+    for (auto* chunk : _chunks)
+        deallocateChunk(chunk);
+
+    _chunks.clear();
+    _size = 0;
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+void ChunkedVector<T, ChunkSize, Allocator>::reserve(size_type n)
+{
+    _chunks.reserve((n+ChunkSize-1) / ChunkSize);
+    while (capacity() < n)
+        addChunk();
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+T& ChunkedVector<T, ChunkSize, Allocator>::operator[](size_type i)
+{
+    return _chunks[i / ChunkSize][i % ChunkSize];
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+const T& ChunkedVector<T, ChunkSize, Allocator>::operator[](size_type i) const
+{
+    return _chunks[i / ChunkSize][i % ChunkSize];
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+typename ChunkedVector<T, ChunkSize, Allocator>::size_type
+ChunkedVector<T, ChunkSize, Allocator>::size() const noexcept
+{
+    return _size;
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+typename ChunkedVector<T, ChunkSize, Allocator>::size_type
+ChunkedVector<T, ChunkSize, Allocator>::capacity() const noexcept
+{
+    return _chunks.size() * ChunkSize;
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+bool ChunkedVector<T, ChunkSize, Allocator>::empty() const noexcept
+{
+    return _size == 0;
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+typename ChunkedVector<T, ChunkSize, Allocator>::allocator_type
+ChunkedVector<T, ChunkSize, Allocator>::get_allocator() const noexcept
+{
+    return _allocator;
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+void ChunkedVector<T, ChunkSize, Allocator>::copyElements(const ChunkedVector& other)
+{
+    reserve(other._size);
+    if constexpr (memcpyCopyable) {
+        for (size_type c=0; c*ChunkSize<other._size; ++c)
+            std::memcpy(_chunks[c], other._chunks[c], std::min(ChunkSize, other._size-c*ChunkSize)*sizeof(T));
+        _size = other._size;
+    }
+    else {
+        for (size_type i=0; i<other._size; ++i)
+            emplace_back(other[i]);
+    }
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+void ChunkedVector<T, ChunkSize, Allocator>::addChunk()
+{
+    T* chunk = allocateChunk();
+    try {
+        _chunks.push_back(chunk);
+    }
+    catch (...) {
+        deallocateChunk(chunk);
+        throw;
+    }
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+T* ChunkedVector<T, ChunkSize, Allocator>::allocateChunk()
+{
+    return AllocatorTraits::allocate(_allocator, ChunkSize);
+}
+
+template <typename T, std::size_t ChunkSize, typename Allocator>
+void ChunkedVector<T, ChunkSize, Allocator>::deallocateChunk(T* chunk) noexcept
+{
+    AllocatorTraits::deallocate(_allocator, chunk, ChunkSize);
+}
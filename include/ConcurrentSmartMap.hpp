@@ -0,0 +1,80 @@
+//
+// Project: SmartMap
+// File: ConcurrentSmartMap.hpp
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef SMARTMAP_CONCURRENTSMARTMAP_HPP
+#define SMARTMAP_CONCURRENTSMARTMAP_HPP
+
+
+#include "SmartMap.hpp"
+
+#include <memory>
+#include <shared_mutex>
+
+
+// Thread-safe variant of SmartMap. Keys are distributed over independently
+// locked shards, each of which is a SmartMap guarded with a reader/writer lock:
+// lookups of existing keys only take a shared lock, insertions of new keys an
+// exclusive one. Object types are required to use stable storage (see
+// SmartMap::StorageTraits), so dereferencing the returned Pointers never
+// requires locking. Pointers can be freely copied, moved and destroyed from
+// any thread, but a single Pointer object must not be used from multiple
+// threads at once.
+class ConcurrentSmartMap {
+public:
+    template <typename T>
+    using Pointer = SmartMap::Pointer<T>;
+
+    /// Create a map with nShards independently locked shards
+    explicit ConcurrentSmartMap(std::size_t nShards = 16);
+
+    ConcurrentSmartMap(const ConcurrentSmartMap&) = delete;
+    ConcurrentSmartMap& operator=(const ConcurrentSmartMap&) = delete;
+
+    /// Get a pointer to object of specific type
+    /// T: Data type, must use stable storage
+    /// K: Key type
+    template <typename T, typename K>
+    Pointer<T> getPointer(const K& key);
+
+    /// Overload for string literal -> std::string mapping
+    template <typename T>
+    Pointer<T> getPointer(const char* key);
+
+    /// Overload for std::string_view -> std::string mapping
+    template <typename T>
+    Pointer<T> getPointer(std::string_view key);
+
+    /// Number of shards
+    std::size_t nShards() const noexcept;
+
+private:
+    // Shards are aligned to cache lines to avoid false sharing of the locks
+    struct alignas(64) Shard {
+        std::shared_mutex   mutex; // guards the id maps and object pools
+        std::mutex          pointerMutex; // guards the pointer lists
+        SmartMap            map;
+
+        Shard();
+    };
+
+    std::unique_ptr<Shard[]>    _shards;
+    std::size_t                 _nShards;
+
+    // Select shard for a key of type L mapped with key type K, hashed with
+    // the hash of the shard maps (see SmartMap::KeyTraits)
+    template <typename K, typename L>
+    inline Shard& shard(const L& key) __attribute__((always_inline));
+};
+
+
+#include "ConcurrentSmartMap.inl"
+
+
+#endif //SMARTMAP_CONCURRENTSMARTMAP_HPP
@@ -0,0 +1,72 @@
+//
+// Project: SmartMap
+// File: ConcurrentSmartMap.inl
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <cstdint>
+#include <functional>
+
+
+template <typename T, typename K>
+ConcurrentSmartMap::Pointer<T> ConcurrentSmartMap::getPointer(const K& key)
+{
+    static_assert(SmartMap::ObjectPool<T>::stableAddresses,
+        "ConcurrentSmartMap requires stable storage for T, see SmartMap::StorageTraits");
+
+    auto& s = shard<K>(key);
+
+    // Most lookups hit existing keys, which only requires a shared lock
+    {
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        auto* id = s.map.template findId<T, K>(key);
+        if (id != nullptr)
+            return Pointer<T>(s.map.template storage<T>(), *id);
+    }
+
+    // Key not found, insert it with exclusive access (another thread might
+    // have inserted it in the meanwhile, which getPointer takes care of)
+    std::unique_lock<std::shared_mutex> lock(s.mutex);
+    return s.map.template getPointer<T, K>(key);
+}
+
+template <typename T>
+ConcurrentSmartMap::Pointer<T> ConcurrentSmartMap::getPointer(const char* key)
+{
+    return getPointer<T>(std::string_view(key));
+}
+
+template <typename T>
+ConcurrentSmartMap::Pointer<T> ConcurrentSmartMap::getPointer(std::string_view key)
+{
+    static_assert(SmartMap::ObjectPool<T>::stableAddresses,
+        "ConcurrentSmartMap requires stable storage for T, see SmartMap::StorageTraits");
+
+    // The std::string key hash is transparent, so the shard is the same as for
+    // the corresponding std::string key
+    auto& s = shard<std::string>(key);
+
+    {
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        auto* id = s.map.template findId<T, std::string>(key);
+        if (id != nullptr)
+            return Pointer<T>(s.map.template storage<T>(), *id);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(s.mutex);
+    return s.map.getPointer<T, std::string>(std::string(key));
+}
+
+template <typename K, typename L>
+ConcurrentSmartMap::Shard& ConcurrentSmartMap::shard(const L& key)
+{
+    // Mix the hash since std::hash is identity for integers and the shard maps
+    // use the same hash internally
+    std::uint64_t h = typename SmartMap::KeyTraits<K>::Hash()(key);
+    h = (h * 0x9e3779b97f4a7c15ull) >> 32;
+    return _shards[h % _nShards];
+}
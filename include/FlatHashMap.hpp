@@ -0,0 +1,221 @@
+//
+// Project: SmartMap
+// File: FlatHashMap.hpp
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef SMARTMAP_FLATHASHMAP_HPP
+#define SMARTMAP_FLATHASHMAP_HPP
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+
+// Open-addressing hash map in the style of Swiss tables. Elements are stored
+// in a flat slot array accompanied by an array of one byte control values,
+// which hold 7 bits of the hash of the element in the corresponding slot (or a
+// special value for empty and deleted slots). Lookups probe the control bytes
+// in groups of 16, matching a whole group at once with SIMD instructions where
+// available, and only compare keys of slots whose control byte matches.
+//
+// Interface follows std::unordered_map for the parts implemented. Differences:
+// - Inserting or erasing elements invalidates iterators and references
+// - value_type is std::pair<K, V>, the key must not be modified through it
+// - In case Hash and Equal define is_transparent, keys of other types than K
+//   can be used with find
+// - Allocator is only used for the control byte and slot arrays, elements are
+//   not constructed with it
+template <typename K, typename V, typename Hash = std::hash<K>, typename Equal = std::equal_to<K>,
+    typename Allocator = std::allocator<std::pair<K, V>>>
+class FlatHashMap {
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+    using size_type = std::size_t;
+    using hasher = Hash;
+    using key_equal = Equal;
+    using allocator_type = Allocator;
+
+    template <bool Const>
+    class Iterator {
+    public:
+        using Map = std::conditional_t<Const, const FlatHashMap, FlatHashMap>;
+        using value_type = FlatHashMap::value_type;
+        using reference = std::conditional_t<Const, const value_type&, value_type&>;
+        using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        Iterator() = default;
+        // Conversion from non-const iterator to const iterator
+        template <bool C = Const, typename = std::enable_if_t<C>>
+        Iterator(const Iterator<false>& other);
+
+        reference operator*() const;
+        pointer operator->() const;
+        Iterator& operator++();
+        Iterator operator++(int);
+
+        bool operator==(const Iterator& other) const;
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        friend class FlatHashMap;
+        template <bool> friend class Iterator;
+
+        Iterator(Map* map, size_type index);
+
+        Map*        _map = nullptr;
+        size_type   _index = 0;
+
+        // Move to the next full slot, starting from the current one
+        void skipEmpty();
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashMap() = default;
+    explicit FlatHashMap(const Allocator& allocator);
+
+    FlatHashMap(const FlatHashMap& other);
+    FlatHashMap(const FlatHashMap& other, const Allocator& allocator);
+    FlatHashMap(FlatHashMap&& other) noexcept;
+    FlatHashMap& operator=(const FlatHashMap& other);
+    FlatHashMap& operator=(FlatHashMap&& other) noexcept(
+        std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value ||
+        std::allocator_traits<Allocator>::is_always_equal::value);
+
+    ~FlatHashMap();
+
+    /// Find element with key, returns end() in case it doesn't exist
+    template <typename L>
+    iterator find(const L& key);
+    template <typename L>
+    const_iterator find(const L& key) const;
+
+    /// Find elements with keys, out[i] is set to find(keys[i]). The lookups are
+    /// pipelined: control bytes of the first probed groups of a batch of keys
+    /// are prefetched first, then the first candidate slots, so that the cache
+    /// misses of the lookups overlap instead of being serialized.
+    template <typename L>
+    void find(std::span<const L> keys, const_iterator* out) const;
+
+    /// Insert element with key in case it doesn't exist, the value is
+    /// constructed from args. Returns iterator to the element with the key and
+    /// true in case the insertion took place.
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args);
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args);
+
+    /// Erase element pointed to by an iterator
+    void erase(const_iterator it);
+
+    /// Erase element with key, returns number of elements erased
+    size_type erase(const K& key);
+
+    /// Erase all elements, capacity is retained
+    void clear() noexcept;
+
+    /// Allocate space so that at least n elements fit without rehashing
+    void reserve(size_type n);
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    size_type size() const noexcept;
+    bool empty() const noexcept;
+    /// Number of slots
+    size_type capacity() const noexcept;
+    float load_factor() const noexcept;
+
+    allocator_type get_allocator() const noexcept;
+
+private:
+    static constexpr size_type  GroupSize = 16;
+    static constexpr size_type  MinCapacity = GroupSize;
+    // Number of lookups in flight in batched find
+    static constexpr size_type  BatchSize = 16;
+
+    // Control byte values for slots not containing an element, full slots have
+    // a non-negative value (7 bits of the hash of the element)
+    static constexpr std::int8_t    Empty = -128;
+    static constexpr std::int8_t    Deleted = -2;
+
+    // Group of GroupSize control bytes, matched at once. Bit i of the returned
+    // masks corresponds to slot i of the group.
+    struct Group {
+        const std::int8_t*  ctrl;
+
+        inline std::uint32_t match(std::int8_t tag) const __attribute__((always_inline));
+        inline std::uint32_t matchEmpty() const __attribute__((always_inline));
+        inline std::uint32_t matchEmptyOrDeleted() const __attribute__((always_inline));
+    };
+
+    // Control bytes of a group, used for allocating the control bytes with group alignment
+    struct alignas(GroupSize) CtrlGroup {
+        std::int8_t bytes[GroupSize];
+    };
+
+    using AllocatorTraits = std::allocator_traits<Allocator>;
+    using CtrlAllocator = typename AllocatorTraits::template rebind_alloc<CtrlGroup>;
+
+    std::int8_t*    _ctrl = nullptr;
+    value_type*     _slots = nullptr;
+    size_type       _capacity = 0; // 0 or power of two, at least GroupSize
+    size_type       _size = 0;
+    size_type       _growthLeft = 0; // Number of empty slots that can be filled before rehash
+    Hash            _hash;
+    Equal           _equal;
+    Allocator       _allocator;
+
+    // Hash of a key, mixed so that low-quality (e.g. identity) hashes spread well
+    template <typename L>
+    inline std::size_t hash(const L& key) const __attribute__((always_inline));
+
+    static inline std::size_t h1(std::size_t hash) __attribute__((always_inline));
+    static inline std::int8_t h2(std::size_t hash) __attribute__((always_inline));
+
+    // Maximum number of elements for a capacity (load factor 7/8)
+    static size_type maxSize(size_type capacity);
+
+    // Index of slot containing key, or _capacity if the key doesn't exist
+    template <typename L>
+    inline size_type findIndex(const L& key, std::size_t hash) const __attribute__((always_inline));
+
+    // Index of first empty or deleted slot on probe sequence of hash
+    size_type findNonFull(std::size_t hash) const;
+
+    // Find slot for new element with hash, rehashing if required
+    size_type prepareInsert(std::size_t hash);
+
+    // Reallocate with a new capacity and reinsert all elements
+    void rehash(size_type capacity);
+
+    void allocate(size_type capacity);
+    void deallocate() noexcept;
+    void deallocateArrays(std::int8_t* ctrl, value_type* slots, size_type capacity) noexcept;
+    // Destroy elements and release memory
+    void destroy() noexcept;
+};
+
+
+#include "FlatHashMap.inl"
+
+
+#endif //SMARTMAP_FLATHASHMAP_HPP
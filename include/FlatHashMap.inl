@@ -0,0 +1,654 @@
+//
+// Project: SmartMap
+// File: FlatHashMap.inl
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <cstring>
+#include <new>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <bool Const>
+template <bool C, typename>
+FlatHashMap<K, V, Hash, Equal, Allocator>::Iterator<Const>::Iterator(const Iterator<false>& other) :
+    _map    (other._map),
+    _index  (other._index)
+{
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <bool Const>
+typename FlatHashMap<K, V, Hash, Equal, Allocator>::template Iterator<Const>::reference
+FlatHashMap<K, V, Hash, Equal, Allocator>::Iterator<Const>::operator*() const
+{
+    return _map->_slots[_index];
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <bool Const>
+typename FlatHashMap<K, V, Hash, Equal, Allocator>::template Iterator<Const>::pointer
+FlatHashMap<K, V, Hash, Equal, Allocator>::Iterator<Const>::operator->() const
+{
+    return &_map->_slots[_index];
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <bool Const>
+typename FlatHashMap<K, V, Hash, Equal, Allocator>::template Iterator<Const>&
+FlatHashMap<K, V, Hash, Equal, Allocator>::Iterator<Const>::operator++()
+{
+    ++_index;
+    skipEmpty();
+    return *this;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <bool Const>
+typename FlatHashMap<K, V, Hash, Equal, Allocator>::template Iterator<Const>
+FlatHashMap<K, V, Hash, Equal, Allocator>::Iterator<Const>::operator++(int)
+{
+    auto it = *this;
+    ++(*this);
+    return it;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <bool Const>
+bool FlatHashMap<K, V, Hash, Equal, Allocator>::Iterator<Const>::operator==(const Iterator& other) const
+{
+    return _index == other._index;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <bool Const>
+bool FlatHashMap<K, V, Hash, Equal, Allocator>::Iterator<Const>::operator!=(const Iterator& other) const
+{
+    return _index != other._index;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <bool Const>
+FlatHashMap<K, V, Hash, Equal, Allocator>::Iterator<Const>::Iterator(Map* map, size_type index) :
+    _map    (map),
+    _index  (index)
+{
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <bool Const>
+void FlatHashMap<K, V, Hash, Equal, Allocator>::Iterator<Const>::skipEmpty()
+{
+    while (_index < _map->_capacity && _map->_ctrl[_index] < 0)
+        ++_index;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+FlatHashMap<K, V, Hash, Equal, Allocator>::FlatHashMap(const Allocator& allocator) :
+    _allocator  (allocator)
+{
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+FlatHashMap<K, V, Hash, Equal, Allocator>::FlatHashMap(const FlatHashMap& other) :
+    FlatHashMap(other, AllocatorTraits::select_on_container_copy_construction(other._allocator))
+{
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+FlatHashMap<K, V, Hash, Equal, Allocator>::FlatHashMap(const FlatHashMap& other, const Allocator& allocator) :
+    _hash       (other._hash),
+    _equal      (other._equal),
+    _allocator  (allocator)
+{
+    if (other._size == 0)
+        return;
+
+    allocate(other._capacity);
+    if constexpr (std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>) {
+        // Elements are copied as bytes along with the unused slots, which is
+        // faster than visiting each slot
+        std::memcpy(static_cast<void*>(_slots), other._slots, _capacity*sizeof(value_type));
+    }
+    else {
+        size_type i = 0;
+        try {
+            for (; i<_capacity; ++i) {
+                if (other._ctrl[i] >= 0)
+                    new (&_slots[i]) value_type(other._slots[i]);
+            }
+        }
+        catch (...) {
+            // Destroy the elements copied so far
+            for (size_type j=0; j<i; ++j) {
+                if (other._ctrl[j] >= 0)
+                    _slots[j].~value_type();
+            }
+            deallocate();
+            throw;
+        }
+    }
+
+    std::memcpy(_ctrl, other._ctrl, _capacity);
+    _size = other._size;
+    _growthLeft = other._growthLeft;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+FlatHashMap<K, V, Hash, Equal, Allocator>::FlatHashMap(FlatHashMap&& other) noexcept :
+    _ctrl       (other._ctrl),
+    _slots      (other._slots),
+    _capacity   (other._capacity),
+    _size       (other._size),
+    _growthLeft (other._growthLeft),
+    _hash       (std::move(other._hash)),
+    _equal      (std::move(other._equal)),
+    _allocator  (other._allocator)
+{
+    other._ctrl = nullptr;
+    other._slots = nullptr;
+    other._capacity = 0;
+    other._size = 0;
+    other._growthLeft = 0;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+FlatHashMap<K, V, Hash, Equal, Allocator>&
+FlatHashMap<K, V, Hash, Equal, Allocator>::operator=(const FlatHashMap& other)
+{
+    if (this == &other)
+        return *this;
+
+    FlatHashMap copy(other, AllocatorTraits::propagate_on_container_copy_assignment::value ?
+        other._allocator : _allocator);
+    *this = std::move(copy);
+
+    return *this;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+FlatHashMap<K, V, Hash, Equal, Allocator>&
+FlatHashMap<K, V, Hash, Equal, Allocator>::operator=(FlatHashMap&& other) noexcept(
+    std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value ||
+    std::allocator_traits<Allocator>::is_always_equal::value)
+{
+    if (this == &other)
+        return *this;
+
+    destroy();
+
+    // The arrays can only be taken over if they can be deallocated with our
+    // allocator, otherwise the elements are moved one by one
+    if constexpr (!AllocatorTraits::propagate_on_container_move_assignment::value &&
+        !AllocatorTraits::is_always_equal::value) {
+        if (_allocator != other._allocator) {
+            _hash = other._hash;
+            _equal = other._equal;
+            reserve(other._size);
+            for (auto& element : other)
+                try_emplace(std::move(element.first), std::move(element.second));
+            other.destroy();
+            return *this;
+        }
+    }
+
+    _ctrl = other._ctrl;
+    _slots = other._slots;
+    _capacity = other._capacity;
+    _size = other._size;
+    _growthLeft = other._growthLeft;
+    _hash = std::move(other._hash);
+    _equal = std::move(other._equal);
+    if constexpr (AllocatorTraits::propagate_on_container_move_assignment::value)
+        _allocator = other._allocator;
+
+    other._ctrl = nullptr;
+    other._slots = nullptr;
+    other._capacity = 0;
+    other._size = 0;
+    other._growthLeft = 0;
+
+    return *this;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+FlatHashMap<K, V, Hash, Equal, Allocator>::~FlatHashMap()
+{
+    destroy();
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <typename L>
+typename
+FlatHashMap<K, V, Hash, Equal, Allocator>::iterator FlatHashMap<K, V, Hash, Equal, Allocator>::find(const L& key)
+{
+    return iterator(this, findIndex(key, hash(key)));
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <typename L>
+typename
+FlatHashMap<K, V, Hash, Equal, Allocator>::const_iterator FlatHashMap<K, V, Hash, Equal, Allocator>::find(const L& key) const
+{
+    return const_iterator(this, findIndex(key, hash(key)));
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <typename L>
+void FlatHashMap<K, V, Hash, Equal, Allocator>::find(std::span<const L> keys, const_iterator* out) const
+{
+    if (_capacity == 0) {
+        for (size_type i=0; i<keys.size(); ++i)
+            out[i] = end();
+        return;
+    }
+
+    size_type groupMask = _capacity/GroupSize - 1;
+    std::size_t hashes[BatchSize];
+    for (size_type b=0; b<keys.size(); b+=BatchSize) {
+        size_type n = std::min(BatchSize, keys.size()-b);
+
+        // Hash the keys and prefetch the control bytes of their first groups
+        for (size_type i=0; i<n; ++i) {
+            hashes[i] = hash(keys[b+i]);
+            __builtin_prefetch(_ctrl + (h1(hashes[i]) & groupMask)*GroupSize);
+        }
+
+        // Prefetch the first slots with matching control byte
+        for (size_type i=0; i<n; ++i) {
+            size_type group = h1(hashes[i]) & groupMask;
+            auto m = Group{ _ctrl + group*GroupSize }.match(h2(hashes[i]));
+            if (m != 0)
+                __builtin_prefetch(&_slots[group*GroupSize + __builtin_ctz(m)]);
+        }
+
+        // Complete the lookups, which mostly hit the cache by now
+        for (size_type i=0; i<n; ++i)
+            out[b+i] = const_iterator(this, findIndex(keys[b+i], hashes[i]));
+    }
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <typename... Args>
+std::pair<typename FlatHashMap<K, V, Hash, Equal, Allocator>::iterator, bool>
+FlatHashMap<K, V, Hash, Equal, Allocator>::try_emplace(const K& key, Args&&... args)
+{
+    auto h = hash(key);
+    auto index = findIndex(key, h);
+    if (index != _capacity)
+        return { iterator(this, index), false };
+
+    index = prepareInsert(h);
+    new (&_slots[index]) value_type(std::piecewise_construct,
+        std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+
+    // Only mark the slot full once the element has been constructed
+    if (_ctrl[index] == Empty)
+        --_growthLeft;
+    _ctrl[index] = h2(h);
+    ++_size;
+
+    return { iterator(this, index), true };
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <typename... Args>
+std::pair<typename FlatHashMap<K, V, Hash, Equal, Allocator>::iterator, bool>
+FlatHashMap<K, V, Hash, Equal, Allocator>::try_emplace(K&& key, Args&&... args)
+{
+    auto h = hash(key);
+    auto index = findIndex(key, h);
+    if (index != _capacity)
+        return { iterator(this, index), false };
+
+    index = prepareInsert(h);
+    new (&_slots[index]) value_type(std::piecewise_construct,
+        std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+
+    if (_ctrl[index] == Empty)
+        --_growthLeft;
+    _ctrl[index] = h2(h);
+    ++_size;
+
+    return { iterator(this, index), true };
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+void FlatHashMap<K, V, Hash, Equal, Allocator>::erase(const_iterator it)
+{
+    auto index = it._index;
+    _slots[index].~value_type();
+    --_size;
+
+    // In case the group still has an empty slot, no probe sequence has ever
+    // continued past it and the slot can be marked empty instead of deleted
+    Group group { _ctrl + index/GroupSize*GroupSize };
+    if (group.matchEmpty()) {
+        _ctrl[index] = Empty;
+        ++_growthLeft;
+    }
+    else
+        _ctrl[index] = Deleted;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+typename
+FlatHashMap<K, V, Hash, Equal, Allocator>::size_type FlatHashMap<K, V, Hash, Equal, Allocator>::erase(const K& key)
+{
+    auto index = findIndex(key, hash(key));
+    if (index == _capacity)
+        return 0;
+
+    erase(const_iterator(this, index));
+    return 1;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+void FlatHashMap<K, V, Hash, Equal, Allocator>::clear() noexcept
+{
+    for (size_type i=0; i<_capacity; ++i) {
+        if (_ctrl[i] >= 0)
+            _slots[i].~value_type();
+    }
+
+    if (_capacity > 0)
+        std::memset(_ctrl, Empty, _capacity);
+    _size = 0;
+    _growthLeft = maxSize(_capacity);
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+void FlatHashMap<K, V, Hash, Equal, Allocator>::reserve(size_type n)
+{
+    if (n <= maxSize(_capacity))
+        return;
+
+    auto capacity = _capacity > 0 ? _capacity : MinCapacity;
+    while (maxSize(capacity) < n)
+        capacity *= 2;
+
+    rehash(capacity);
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+typename
+FlatHashMap<K, V, Hash, Equal, Allocator>::iterator FlatHashMap<K, V, Hash, Equal, Allocator>::begin()
+{
+    iterator it(this, 0);
+    it.skipEmpty();
+    return it;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+typename FlatHashMap<K, V, Hash, Equal, Allocator>::iterator FlatHashMap<K, V, Hash, Equal, Allocator>::end()
+{
+    return iterator(this, _capacity);
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+typename
+FlatHashMap<K, V, Hash, Equal, Allocator>::const_iterator FlatHashMap<K, V, Hash, Equal, Allocator>::begin() const
+{
+    const_iterator it(this, 0);
+    it.skipEmpty();
+    return it;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+typename
+FlatHashMap<K, V, Hash, Equal, Allocator>::const_iterator FlatHashMap<K, V, Hash, Equal, Allocator>::end() const
+{
+    return const_iterator(this, _capacity);
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+typename
+FlatHashMap<K, V, Hash, Equal, Allocator>::size_type FlatHashMap<K, V, Hash, Equal, Allocator>::size() const noexcept
+{
+    return _size;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+bool FlatHashMap<K, V, Hash, Equal, Allocator>::empty() const noexcept
+{
+    return _size == 0;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+typename
+FlatHashMap<K, V, Hash, Equal, Allocator>::size_type FlatHashMap<K, V, Hash, Equal, Allocator>::capacity() const noexcept
+{
+    return _capacity;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+float FlatHashMap<K, V, Hash, Equal, Allocator>::load_factor() const noexcept
+{
+    return _capacity > 0 ? (float)_size / _capacity : 0.0f;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+typename FlatHashMap<K, V, Hash, Equal, Allocator>::allocator_type
+FlatHashMap<K, V, Hash, Equal, Allocator>::get_allocator() const noexcept
+{
+    return _allocator;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+std::uint32_t FlatHashMap<K, V, Hash, Equal, Allocator>::Group::match(std::int8_t tag) const
+{
+#ifdef __SSE2__
+    auto c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), c));
+#else
+    std::uint32_t mask = 0;
+    for (size_type i=0; i<GroupSize; ++i)
+        mask |= (std::uint32_t)(ctrl[i] == tag) << i;
+    return mask;
+#endif
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+std::uint32_t FlatHashMap<K, V, Hash, Equal, Allocator>::Group::matchEmpty() const
+{
+    return match(Empty);
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+std::uint32_t FlatHashMap<K, V, Hash, Equal, Allocator>::Group::matchEmptyOrDeleted() const
+{
+#ifdef __SSE2__
+    // Empty and Deleted are the only values less than -1
+    auto c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), c));
+#else
+    std::uint32_t mask = 0;
+    for (size_type i=0; i<GroupSize; ++i)
+        mask |= (std::uint32_t)(ctrl[i] < -1) << i;
+    return mask;
+#endif
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <typename L>
+std::size_t FlatHashMap<K, V, Hash, Equal, Allocator>::hash(const L& key) const
+{
+    std::uint64_t h = _hash(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+std::size_t FlatHashMap<K, V, Hash, Equal, Allocator>::h1(std::size_t hash)
+{
+    return hash >> 7;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+std::int8_t FlatHashMap<K, V, Hash, Equal, Allocator>::h2(std::size_t hash)
+{
+    return hash & 0x7f;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+typename
+FlatHashMap<K, V, Hash, Equal, Allocator>::size_type FlatHashMap<K, V, Hash, Equal, Allocator>::maxSize(size_type capacity)
+{
+    return capacity - capacity/8;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+template <typename L>
+typename FlatHashMap<K, V, Hash, Equal, Allocator>::size_type
+FlatHashMap<K, V, Hash, Equal, Allocator>::findIndex(const L& key, std::size_t hash) const
+{
+    if (_capacity == 0)
+        return 0;
+
+    // Groups are probed with triangular sequence, which visits every group
+    // since the number of groups is a power of two
+    size_type groupMask = _capacity/GroupSize - 1;
+    size_type group = h1(hash) & groupMask;
+    auto tag = h2(hash);
+    for (size_type i=1;; ++i) {
+        Group g { _ctrl + group*GroupSize };
+        for (auto m = g.match(tag); m != 0; m &= m-1) {
+            auto index = group*GroupSize + __builtin_ctz(m);
+            if (_equal(_slots[index].first, key))
+                return index;
+        }
+
+        // Key would've been inserted to the first empty slot
+        if (g.matchEmpty())
+            return _capacity;
+
+        group = (group + i) & groupMask;
+    }
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+typename FlatHashMap<K, V, Hash, Equal, Allocator>::size_type
+FlatHashMap<K, V, Hash, Equal, Allocator>::findNonFull(std::size_t hash) const
+{
+    size_type groupMask = _capacity/GroupSize - 1;
+    size_type group = h1(hash) & groupMask;
+    for (size_type i=1;; ++i) {
+        auto m = Group{ _ctrl + group*GroupSize }.matchEmptyOrDeleted();
+        if (m != 0)
+            return group*GroupSize + __builtin_ctz(m);
+
+        group = (group + i) & groupMask;
+    }
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+typename FlatHashMap<K, V, Hash, Equal, Allocator>::size_type
+FlatHashMap<K, V, Hash, Equal, Allocator>::prepareInsert(std::size_t hash)
+{
+    if (_capacity > 0) {
+        auto index = findNonFull(hash);
+        // Reusing a deleted slot doesn't consume the growth budget
+        if (_growthLeft > 0 || _ctrl[index] == Deleted)
+            return index;
+    }
+
+    // Grow in case the table is more than half full, otherwise most of the used
+    // slots are deleted ones and rehashing with the same capacity frees them
+    if (_capacity == 0)
+        rehash(MinCapacity);
+    else if (_size >= maxSize(_capacity)/2)
+        rehash(_capacity*2);
+    else
+        rehash(_capacity);
+
+    return findNonFull(hash);
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+void FlatHashMap<K, V, Hash, Equal, Allocator>::rehash(size_type capacity)
+{
+    auto* oldCtrl = _ctrl;
+    auto* oldSlots = _slots;
+    auto oldCapacity = _capacity;
+
+    allocate(capacity);
+
+    for (size_type i=0; i<oldCapacity; ++i) {
+        if (oldCtrl[i] < 0)
+            continue;
+
+        auto h = hash(oldSlots[i].first);
+        auto index = findNonFull(h);
+        new (&_slots[index]) value_type(std::move(oldSlots[i]));
+        oldSlots[i].~value_type();
+        _ctrl[index] = h2(h);
+    }
+    _growthLeft -= _size;
+
+    if (oldCapacity > 0)
+        deallocateArrays(oldCtrl, oldSlots, oldCapacity);
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+void FlatHashMap<K, V, Hash, Equal, Allocator>::allocate(size_type capacity)
+{
+    // Control bytes are allocated as whole groups to get the group alignment
+    CtrlAllocator ctrlAllocator(_allocator);
+    auto* ctrl = std::allocator_traits<CtrlAllocator>::allocate(ctrlAllocator, capacity/GroupSize);
+    try {
+        _slots = AllocatorTraits::allocate(_allocator, capacity);
+    }
+    catch (...) {
+        std::allocator_traits<CtrlAllocator>::deallocate(ctrlAllocator, ctrl, capacity/GroupSize);
+        throw;
+    }
+
+    _ctrl = ctrl->bytes;
+    std::memset(_ctrl, Empty, capacity);
+    _capacity = capacity;
+    _growthLeft = maxSize(capacity);
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+void FlatHashMap<K, V, Hash, Equal, Allocator>::deallocate() noexcept
+{
+    if (_capacity > 0)
+        deallocateArrays(_ctrl, _slots, _capacity);
+
+    _ctrl = nullptr;
+    _slots = nullptr;
+    _capacity = 0;
+    _size = 0;
+    _growthLeft = 0;
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+void FlatHashMap<K, V, Hash, Equal, Allocator>::deallocateArrays(
+    std::int8_t* ctrl, value_type* slots, size_type capacity) noexcept
+{
+    CtrlAllocator ctrlAllocator(_allocator);
+    std::allocator_traits<CtrlAllocator>::deallocate(ctrlAllocator,
+        reinterpret_cast<CtrlGroup*>(ctrl), capacity/GroupSize);
+    AllocatorTraits::deallocate(_allocator, slots, capacity);
+}
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+void FlatHashMap<K, V, Hash, Equal, Allocator>::destroy() noexcept
+{
+    for (size_type i=0; i<_capacity; ++i) {
+        if (_ctrl[i] >= 0)
+            _slots[i].~value_type();
+    }
+
+    deallocate();
+}
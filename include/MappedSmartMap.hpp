@@ -0,0 +1,126 @@
+//
+// Project: SmartMap
+// File: MappedSmartMap.hpp
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef SMARTMAP_MAPPEDSMARTMAP_HPP
+#define SMARTMAP_MAPPEDSMARTMAP_HPP
+
+
+#include "SmartMap.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+
+// Read-only view of a file written with SmartMap::save. The file is memory
+// mapped and the object and key arrays are accessed in place, so opening it
+// does not construct any objects or build any indices: the cost of a lookup is
+// paid by the pages it touches. Lookups binary search the key hashes stored in
+// the file.
+// Only object types stored as raw bytes (see SmartMap::SerializationTraits)
+// can be accessed, and only with keys stored as raw bytes or std::string keys.
+// Sections of other types in the file are skipped.
+class MappedSmartMap {
+public:
+    /// Map file in path, throws std::runtime_error in case the file can't be
+    /// mapped or is not a valid SmartMap file
+    explicit MappedSmartMap(const std::string& path);
+
+    MappedSmartMap(const MappedSmartMap&) = delete;
+    MappedSmartMap(MappedSmartMap&&) noexcept;
+    MappedSmartMap& operator=(const MappedSmartMap&) = delete;
+    MappedSmartMap& operator=(MappedSmartMap&&) noexcept;
+
+    ~MappedSmartMap();
+
+    /// Find object of type T with key of type K, returns nullptr in case the
+    /// key doesn't exist. The returned pointer is valid for the lifetime of the
+    /// MappedSmartMap.
+    template <typename T, typename K>
+    const T* find(const K& key) const;
+
+    /// Overload for string literal -> std::string mapping
+    template <typename T>
+    const T* find(const char* key) const;
+
+    /// Overload for std::string_view -> std::string mapping
+    template <typename T>
+    const T* find(std::string_view key) const;
+
+    /// Call f(const T&) for each object of type T in storage order
+    template <typename T, typename F>
+    void forEach(F&& f) const;
+
+private:
+    friend class SharedSmartMap;
+
+    // Map file open in fd, takes ownership of fd. name is used in error messages.
+    MappedSmartMap(int fd, const std::string& name);
+
+    // Location of an IdMap within the file. Entries are sorted by hash.
+    struct KeySection {
+        std::uint64_t           keySize     = 0;
+        std::uint64_t           n           = 0;
+        bool                    raw         = false;
+        const std::uint64_t*    hashes      = nullptr;
+        const std::uint64_t*    ids         = nullptr;
+        // Raw key array, or serialized keys located with offsets
+        const char*             keys        = nullptr;
+        std::uint64_t           keysSize    = 0;
+        const std::uint64_t*    offsets     = nullptr;
+    };
+
+    // Location of a TypeStorage within the file
+    struct TypeSection {
+        std::uint64_t           objectSize  = 0;
+        std::uint64_t           n           = 0;
+        bool                    raw         = false;
+        const char*             objects     = nullptr;
+        const std::uint64_t*    activeBits  = nullptr;
+        const std::uint32_t*    generations = nullptr;
+        // Keyed by StableTypeIds of the key types
+        std::unordered_map<SmartMap::StableTypeId, KeySection>   keySections;
+    };
+
+    void*                   _data;
+    std::size_t             _size;
+    // Keyed by StableTypeIds of the object types
+    std::unordered_map<SmartMap::StableTypeId, TypeSection>  _typeSections;
+
+    // Parse the section locations from the mapped file
+    void parse();
+
+    // Find ID of object of type T with key of type L from IdMap of key type K,
+    // returns nullptr in case the key doesn't exist
+    template <typename T, typename K, typename L>
+    const std::uint64_t* findId(const L& key) const;
+
+    // Object of type T with ID id, nullptr in case the slot doesn't exist or is
+    // inactive. Generation of the slot is stored to generation if not nullptr.
+    template <typename T>
+    const T* object(std::uint64_t id, std::uint32_t* generation = nullptr) const;
+
+    // Section of type T, nullptr in case T is not in the file
+    template <typename T>
+    const TypeSection* findTypeSection() const;
+
+    // Index of key in key section, n in case it doesn't exist. K is
+    // the key type in file, L the type of the key looked up.
+    template <typename K, typename L>
+    static std::uint64_t findKey(const KeySection& section, const L& key);
+};
+
+
+#include "MappedSmartMap.inl"
+
+
+#endif //SMARTMAP_MAPPEDSMARTMAP_HPP
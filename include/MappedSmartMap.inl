@@ -0,0 +1,126 @@
+//
+// Project: SmartMap
+// File: MappedSmartMap.inl
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <algorithm>
+#include <cstring>
+
+
+template <typename T, typename K>
+const T* MappedSmartMap::find(const K& key) const
+{
+    auto* id = findId<T, K>(key);
+    return id != nullptr ? object<T>(*id) : nullptr;
+}
+
+template <typename T>
+const T* MappedSmartMap::find(const char* key) const
+{
+    return find<T>(std::string_view(key));
+}
+
+template <typename T>
+const T* MappedSmartMap::find(std::string_view key) const
+{
+    auto* id = findId<T, std::string>(key);
+    return id != nullptr ? object<T>(*id) : nullptr;
+}
+
+template <typename T, typename F>
+void MappedSmartMap::forEach(F&& f) const
+{
+    static_assert(SmartMap::SerializationTraits<T>::raw,
+        "MappedSmartMap requires objects stored as raw bytes");
+
+    auto* typeSection = findTypeSection<T>();
+    if (typeSection == nullptr)
+        return;
+
+    auto* objects = reinterpret_cast<const T*>(typeSection->objects);
+    for (std::uint64_t i=0; i<typeSection->n; ++i)
+        if (typeSection->activeBits[i/64] & ((std::uint64_t)1 << (i%64)))
+            f(objects[i]);
+}
+
+template <typename T, typename K, typename L>
+const std::uint64_t* MappedSmartMap::findId(const L& key) const
+{
+    static_assert(SmartMap::SerializationTraits<T>::raw,
+        "MappedSmartMap requires objects stored as raw bytes");
+    static_assert(SmartMap::SerializationTraits<K>::raw || std::is_same_v<K, std::string>,
+        "MappedSmartMap requires keys stored as raw bytes or std::string keys");
+
+    auto* typeSection = findTypeSection<T>();
+    if (typeSection == nullptr)
+        return nullptr;
+
+    auto it = typeSection->keySections.find(SmartMap::getStableTypeId<K>());
+    if (it == typeSection->keySections.end() || it->second.keySize != sizeof(K) ||
+        it->second.raw != SmartMap::SerializationTraits<K>::raw)
+        return nullptr;
+
+    auto& keySection = it->second;
+    auto i = findKey<K>(keySection, key);
+    if (i == keySection.n)
+        return nullptr;
+
+    return keySection.ids + i;
+}
+
+template <typename T>
+const T* MappedSmartMap::object(std::uint64_t id, std::uint32_t* generation) const
+{
+    auto* typeSection = findTypeSection<T>();
+    if (typeSection == nullptr || id >= typeSection->n ||
+        !(typeSection->activeBits[id/64] & ((std::uint64_t)1 << (id%64))))
+        return nullptr;
+
+    if (generation != nullptr)
+        *generation = typeSection->generations[id];
+    return reinterpret_cast<const T*>(typeSection->objects) + id;
+}
+
+template <typename T>
+const MappedSmartMap::TypeSection* MappedSmartMap::findTypeSection() const
+{
+    auto it = _typeSections.find(SmartMap::getStableTypeId<T>());
+    if (it == _typeSections.end() || !it->second.raw || it->second.objectSize != sizeof(T))
+        return nullptr;
+    return &it->second;
+}
+
+template <typename K, typename L>
+std::uint64_t MappedSmartMap::findKey(const KeySection& section, const L& key)
+{
+    std::uint64_t hash = typename SmartMap::KeyTraits<K>::Hash()(key);
+    auto* first = std::lower_bound(section.hashes, section.hashes + section.n, hash);
+
+    // Hashes can collide, compare all the keys with a matching hash
+    for (auto* h = first; h != section.hashes + section.n && *h == hash; ++h) {
+        auto i = (std::uint64_t)(h - section.hashes);
+        if constexpr (std::is_same_v<K, std::string>) {
+            // Serialized strings are the length followed by the characters
+            auto offset = section.offsets[i];
+            std::uint64_t length;
+            if (offset > section.keysSize || section.keysSize - offset < sizeof(length))
+                continue;
+            std::memcpy(&length, section.keys + offset, sizeof(length));
+            offset += sizeof(length);
+            if (length <= section.keysSize - offset &&
+                std::string_view(section.keys + offset, length) == key)
+                return i;
+        }
+        else {
+            if (typename SmartMap::KeyTraits<K>::Equal()(reinterpret_cast<const K*>(section.keys)[i], key))
+                return i;
+        }
+    }
+
+    return section.n;
+}
@@ -0,0 +1,150 @@
+//
+// Project: SmartMap
+// File: SharedSmartMap.hpp
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef SMARTMAP_SHAREDSMARTMAP_HPP
+#define SMARTMAP_SHAREDSMARTMAP_HPP
+
+
+#include "MappedSmartMap.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+
+// Read-only access to SmartMaps published into POSIX shared memory. A writer
+// process publishes versions of a SmartMap with publish, any number of reader
+// processes access the latest published version in place through
+// SharedSmartMap objects (see MappedSmartMap for the supported types).
+//
+// Each version is stored in a separate shared memory object, and the version
+// number is published through an atomic in a small control object, so neither
+// the writer nor the readers ever block each other: readers keep the version
+// they have mapped until they call refresh, and the objects of old versions are
+// freed once the last reader unmaps them.
+//
+// Pointers refer to objects by their slot in the map rather than by address,
+// so they keep working across refresh (unless the key of the object was erased
+// in the new version) even though the new version is mapped elsewhere. They
+// refer to the SharedSmartMap object they were obtained from, which must not
+// be moved or destroyed while they are in use.
+//
+// Only one process may publish a name at a time. A SharedSmartMap object and
+// its Pointers must not be used from multiple threads at once.
+class SharedSmartMap {
+public:
+    template <typename T>
+    class Pointer {
+    public:
+        friend class SharedSmartMap;
+
+        Pointer();
+
+        /// Dereference the pointer, only valid pointers can be dereferenced
+        const T& operator*() const;
+        const T* operator->() const;
+
+        /// Check whether the pointer points to an object. Pointers get
+        /// invalidated when their key is erased from a version the
+        /// SharedSmartMap is refreshed to.
+        bool isValid() const noexcept;
+
+    private:
+        Pointer(const SharedSmartMap* map, std::uint64_t objectId, std::uint32_t generation, const T* objectPtr);
+
+        const SharedSmartMap*   _map; // Map the pointer was obtained from
+        std::uint64_t           _objectId; // ID of the object slot
+        std::uint32_t           _generation; // Generation of the slot when the pointer was created
+        mutable const T*        _objectPtr; // Address of the object in the mapped version
+        mutable std::uint64_t   _version; // Version the address belongs to
+
+        // Update _objectPtr to the mapped version of the map
+        void rebind() const noexcept;
+    };
+
+    /// Open the latest version of the map published with name, throws
+    /// std::runtime_error in case the map hasn't been published
+    explicit SharedSmartMap(const std::string& name);
+
+    SharedSmartMap(const SharedSmartMap&) = delete;
+    SharedSmartMap(SharedSmartMap&&) noexcept;
+    SharedSmartMap& operator=(const SharedSmartMap&) = delete;
+    SharedSmartMap& operator=(SharedSmartMap&&) noexcept;
+
+    ~SharedSmartMap();
+
+    /// Publish map as a new version under name, which needs to be a valid
+    /// shared memory object name without the leading slash. Returns the number
+    /// of the version. Throws std::runtime_error in case publishing fails.
+    static std::uint64_t publish(const SmartMap& map, const std::string& name);
+
+    /// Remove the map published with name. Readers keep the version they have
+    /// mapped, but new ones can't open the map.
+    static void unlink(const std::string& name);
+
+    /// Switch to the latest published version, returns true in case it differs
+    /// from the current one. Addresses returned by find are invalidated.
+    bool refresh();
+
+    /// Number of the mapped version
+    std::uint64_t version() const noexcept;
+
+    /// Get a pointer to object of type T with key of type K, the pointer is
+    /// invalid in case the key doesn't exist (the map is never modified)
+    template <typename T, typename K>
+    Pointer<T> getPointer(const K& key) const;
+
+    /// Overload for string literal -> std::string mapping
+    template <typename T>
+    Pointer<T> getPointer(const char* key) const;
+
+    /// Overload for std::string_view -> std::string mapping
+    template <typename T>
+    Pointer<T> getPointer(std::string_view key) const;
+
+    /// Find object of type T with key of type K, returns nullptr in case the
+    /// key doesn't exist. The returned pointer is valid until refresh.
+    template <typename T, typename K>
+    const T* find(const K& key) const;
+
+    /// Overload for string literal -> std::string mapping
+    template <typename T>
+    const T* find(const char* key) const;
+
+    /// Overload for std::string_view -> std::string mapping
+    template <typename T>
+    const T* find(std::string_view key) const;
+
+private:
+    // Contents of the control object
+    struct Control {
+        std::atomic<std::uint64_t>  version; // Latest published version, 0 if none
+    };
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+        "SharedSmartMap requires lock-free 64-bit atomics to share them between processes");
+
+    std::string                     _name;
+    const Control*                  _control;
+    std::unique_ptr<MappedSmartMap> _map;
+    std::uint64_t                   _version;
+
+    // Names of the shared memory objects
+    static std::string controlName(const std::string& name);
+    static std::string versionName(const std::string& name, std::uint64_t version);
+};
+
+
+#include "SharedSmartMap.inl"
+
+
+#endif //SMARTMAP_SHAREDSMARTMAP_HPP
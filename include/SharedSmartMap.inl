@@ -0,0 +1,115 @@
+//
+// Project: SmartMap
+// File: SharedSmartMap.inl
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+
+template <typename T>
+SharedSmartMap::Pointer<T>::Pointer() :
+    _map        (nullptr),
+    _objectId   (0),
+    _generation (0),
+    _objectPtr  (nullptr),
+    _version    (0)
+{
+}
+
+template <typename T>
+SharedSmartMap::Pointer<T>::Pointer(const SharedSmartMap* map, std::uint64_t objectId,
+    std::uint32_t generation, const T* objectPtr) :
+    _map        (map),
+    _objectId   (objectId),
+    _generation (generation),
+    _objectPtr  (objectPtr),
+    _version    (map->_version)
+{
+}
+
+template <typename T>
+const T& SharedSmartMap::Pointer<T>::operator*() const
+{
+    if (_version != _map->_version)
+        rebind();
+    return *_objectPtr;
+}
+
+template <typename T>
+const T* SharedSmartMap::Pointer<T>::operator->() const
+{
+    return &**this;
+}
+
+template <typename T>
+bool SharedSmartMap::Pointer<T>::isValid() const noexcept
+{
+    if (_map == nullptr)
+        return false;
+    if (_version != _map->_version)
+        rebind();
+    return _objectPtr != nullptr;
+}
+
+template <typename T>
+void SharedSmartMap::Pointer<T>::rebind() const noexcept
+{
+    // The object is at the same slot in the new version unless the slot has
+    // been released (and possibly reused) in the meanwhile
+    std::uint32_t generation;
+    _objectPtr = _map->_map->template object<T>(_objectId, &generation);
+    if (_objectPtr != nullptr && generation != _generation)
+        _objectPtr = nullptr;
+    _version = _map->_version;
+}
+
+template <typename T, typename K>
+SharedSmartMap::Pointer<T> SharedSmartMap::getPointer(const K& key) const
+{
+    auto* id = _map->findId<T, K>(key);
+    std::uint32_t generation;
+    const T* objectPtr = id != nullptr ? _map->object<T>(*id, &generation) : nullptr;
+    if (objectPtr == nullptr)
+        return Pointer<T>();
+
+    return Pointer<T>(this, *id, generation, objectPtr);
+}
+
+template <typename T>
+SharedSmartMap::Pointer<T> SharedSmartMap::getPointer(const char* key) const
+{
+    return getPointer<T>(std::string_view(key));
+}
+
+template <typename T>
+SharedSmartMap::Pointer<T> SharedSmartMap::getPointer(std::string_view key) const
+{
+    auto* id = _map->findId<T, std::string>(key);
+    std::uint32_t generation;
+    const T* objectPtr = id != nullptr ? _map->object<T>(*id, &generation) : nullptr;
+    if (objectPtr == nullptr)
+        return Pointer<T>();
+
+    return Pointer<T>(this, *id, generation, objectPtr);
+}
+
+template <typename T, typename K>
+const T* SharedSmartMap::find(const K& key) const
+{
+    return _map->find<T, K>(key);
+}
+
+template <typename T>
+const T* SharedSmartMap::find(const char* key) const
+{
+    return _map->find<T>(key);
+}
+
+template <typename T>
+const T* SharedSmartMap::find(std::string_view key) const
+{
+    return _map->find<T>(key);
+}
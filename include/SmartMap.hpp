@@ -14,44 +14,148 @@
 
 #include <vector>
 #include <unordered_map>
+#include <map>
+#include <string>
+#include <string_view>
+#include <span>
+#include <type_traits>
+#include <cstdint>
+#include <bit>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <memory_resource>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <exception>
+#include <system_error>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#include "ChunkedVector.hpp"
+#include "FlatHashMap.hpp"
+
+
+template <typename... Types>
+class StaticSmartMap;
 
 
 class SmartMap {
+public:
+    /// Storage backend selection for object type T. By default objects are stored
+    /// in a contiguous vector, which gets reallocated as the pool grows, requiring
+    /// all Pointers of the type to be updated. Specialize with nonzero chunkSize to
+    /// store objects in fixed-size chunks instead, which never move in memory:
+    ///
+    ///     template <>
+    ///     struct SmartMap::StorageTraits<MyType> {
+    ///         static constexpr std::size_t chunkSize = 1024;
+    ///     };
+    ///
+    /// The specialization needs to be visible before the first use of the type.
+    template <typename T>
+    struct StorageTraits {
+        static constexpr std::size_t chunkSize = 0;
+    };
+
+    /// Pointer update strategy for object type T, matters only for the default
+    /// vector storage. By default all Pointers of the type are updated when the
+    /// pool gets reallocated, which costs time proportional to the number of
+    /// Pointers on the insertion causing the reallocation. With lazyRebinding
+    /// the reallocation only increments an epoch, and each Pointer resolves the
+    /// new address of its object on the first dereference afterwards. Suits
+    /// types with many Pointers that are rarely dereferenced, at the cost of a
+    /// check on every dereference:
+    ///
+    ///     template <>
+    ///     struct SmartMap::PointerTraits<MyType> {
+    ///         static constexpr bool lazyRebinding = true;
+    ///     };
+    template <typename T>
+    struct PointerTraits {
+        static constexpr bool lazyRebinding = false;
+    };
+
 private:
     template <typename T>
     struct ObjectPool;
 
-    // Type alias for indexing ObjectPool vector
     template <typename T>
-    using Id = typename std::vector<typename ObjectPool<T>::Wrapper>::size_type;
+    struct TypeStorage;
+
+    // Type alias for indexing ObjectPool
+    template <typename T>
+    using Id = std::size_t;
 
-    // Helper type for pooling objects to avoid unnecessary (de-)allocations
+    // Helper type for pooling objects to avoid unnecessary (de-)allocations.
+    // Objects are stored densely in a separate array from the per-slot data,
+    // and activity of the slots is tracked in a bitmap scanned a word at a time.
     template <typename T>
     struct ObjectPool {
-        struct Wrapper {
-            T       o;
-            bool    active;
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
+        // true if objects never move in memory (pointers and references are never invalidated)
+        static constexpr bool stableAddresses = StorageTraits<T>::chunkSize != 0;
 
-            Wrapper(bool active = false);
-        };
+        // Array type for objects and other per-slot data pointed to by Pointers
+        template <typename U>
+        using Storage = std::conditional_t<stableAddresses,
+            ChunkedVector<U, StorageTraits<T>::chunkSize, std::pmr::polymorphic_allocator<U>>,
+            std::pmr::vector<U>>;
+
+        explicit ObjectPool(const allocator_type& allocator);
+        ObjectPool(const ObjectPool& other, const allocator_type& allocator);
 
         // Return ID of first inactive object, quarantees that object with the returned
         // ID exists after the call. Can set the invalidated flag.
         Id<T> firstInactiveId();
 
+        // Allocate space for n objects. Can set the invalidated flag.
+        void reserve(std::size_t n);
+
+        // Mark object with the ID inactive so that firstInactiveId can reuse it,
+        // increments the generation of the slot
+        void release(Id<T> id);
+
         // Direct object access
         inline T& operator[](Id<T> id) __attribute__((always_inline));
+        inline const T& operator[](Id<T> id) const __attribute__((always_inline));
+
+        inline bool isActive(Id<T> id) const __attribute__((always_inline));
+
+        // Number of slots, active or not
+        inline std::size_t size() const noexcept __attribute__((always_inline));
+
+        // Call f(id) for each active slot with ID in range [begin, end)
+        template <typename F>
+        void forEachActive(Id<T> begin, Id<T> end, F&& f) const;
 
-        std::vector<Wrapper>    data;
-        bool                    invalidated = false; // true if container pointers and iterators are invalidated
+        Storage<T>                  objects;
+        // Incremented every time the object in the slot is released, allows Pointers
+        // to detect that the slot has been reused (wraps around after 2^32 releases)
+        Storage<std::uint32_t>          generations;
+        std::pmr::vector<std::uint64_t> activeBits; // bit i%64 of word i/64 is set if slot i is active
+        std::pmr::vector<Id<T>>         inactiveIds; // free list of released IDs, used as a stack
+        bool                            invalidated = false; // true if container pointers and iterators are invalidated
     };
 
 
 public:
+    template <typename T>
+    class PointerView;
+
     template <typename T>
     class Pointer {
     public:
         friend class SmartMap;
+        friend class ConcurrentSmartMap;
+        friend class PointerView<T>;
+        template <typename... Types>
+        friend class StaticSmartMap;
 
         Pointer();
 
@@ -62,25 +166,103 @@ public:
 
         ~Pointer();
 
+        /// Dereference the pointer, only valid pointers can be dereferenced
         T& operator*();
 
+        /// Check whether the pointer points to an object. Pointers get
+        /// invalidated when their key is erased or their SmartMap destroyed.
+        inline bool isValid() const noexcept __attribute__((always_inline));
+
     private:
-        Pointer(SmartMap* m, Id<T> objectId, T* objectPtr);
-        SmartMap*       _map; // Pointer to parent SmartMap, required for syncing
-        Id<T>           _objectId; // ID of the object in the pool obtained from accessPool, required for syncing
-        T*              _objectPtr; // Pointer to the object
-        Id<Pointer<T>*> _pointerId; // ID of the pointer in the pool obtained from accessPointerPool
+        Pointer(TypeStorage<T>& storage, Id<T> objectId);
+        // Storage of the object, which stays in place when the SmartMap is
+        // moved. Required for syncing.
+        TypeStorage<T>*         _storage;
+        Id<T>                   _objectId; // ID of the object in the pool, required for syncing
+        T*                      _objectPtr; // Pointer to the object
+        const std::uint32_t*    _generationPtr; // Pointer to the generation of the object slot
+        std::uint32_t           _generation; // Generation of the slot when the pointer was created
+        // Value of the pointer epoch of the storage when _objectPtr was resolved,
+        // only used with lazy rebinding (see PointerTraits)
+        std::uint64_t           _epoch;
+        // Neighbours in the list of Pointers registered to the storage
+        Pointer<T>*             _prev;
+        Pointer<T>*             _next;
+
+        // Address of the object, resolved again in case it is stale
+        inline T* objectPtr() const __attribute__((always_inline));
     };
 
-    SmartMap() = default;
+    /// Non-owning view to an object, borrowed from a Pointer. Views are not
+    /// registered to the SmartMap, so copying and destroying them is free and
+    /// dereferencing is a plain memory access. In turn, views are not updated:
+    /// a view is invalidated by anything that invalidates references to the
+    /// objects of its type (insertion of a new key in case the storage is not
+    /// stable, see StorageTraits), erasing a key of the type, and destruction
+    /// of the SmartMap. Debug builds assert on dereferencing a view after any
+    /// of these except insertion into stable storage, for which the view stays
+    /// valid. The debug check shares ownership of a counter with the map, so
+    /// copying views isn't free in debug builds.
+    template <typename T>
+    class PointerView {
+    public:
+        PointerView() noexcept;
+        PointerView(const Pointer<T>& pointer) noexcept;
+
+        /// Dereference the view, only valid views can be dereferenced
+        inline T& operator*() const __attribute__((always_inline));
 
+    private:
+        T*                      _objectPtr; // Pointer to the object
+#ifndef NDEBUG
+        // Epoch of the TypeStorage the view points to, outlives the storage
+        std::shared_ptr<const std::atomic<std::uint64_t>>   _epoch;
+        std::uint64_t           _viewEpoch; // Epoch when the view was created
+#endif
+    };
+
+    /// Construct a SmartMap allocating all of its internal data from the default
+    /// memory resource
+    SmartMap() noexcept;
+
+    /// Construct a SmartMap allocating all of its internal data (objects, keys
+    /// indices and bookkeeping) from resource, which needs to outlive the map.
+    /// Allows backing a SmartMap with e.g. std::pmr::monotonic_buffer_resource.
+    /// Keys and objects allocating memory on their own use their own allocators,
+    /// unless they are allocator-aware with std::pmr::polymorphic_allocator.
+    explicit SmartMap(std::pmr::memory_resource* resource) noexcept;
+
+    /// Copy constructor, the copy uses the default memory resource in the manner
+    /// of std::pmr containers. All data is copied, see snapshot for a copy
+    /// sharing the data.
     SmartMap(const SmartMap&);
+    /// Copy to a SmartMap using memory resource resource
+    SmartMap(const SmartMap& other, std::pmr::memory_resource* resource);
+    /// Move constructor and assignment transfer the data of the other map as is.
+    /// In case the maps use different memory resources, the moved-to map keeps
+    /// using the resource of the other map for the moved data. Move assignment
+    /// between maps using different memory resources allocates and may throw,
+    /// in which case neither of the maps is modified.
     SmartMap(SmartMap&&) noexcept;
     SmartMap& operator=(const SmartMap&);
-    SmartMap& operator=(SmartMap&&) noexcept;
+    SmartMap& operator=(SmartMap&&);
 
     ~SmartMap();
 
+    /// Copy-on-write copy of the map, using the memory resource of the map.
+    /// Data of a type with no live Pointers in the map is shared by the maps
+    /// until either of them gets a Pointer to the type or modifies it in
+    /// another way (erase, forEach, mutable lookup etc.), at which point that
+    /// map copies the data for itself. Lookups with find never copy. Data of
+    /// types with live Pointers is copied right away, since writes through the
+    /// Pointers can't be detected.
+    /// Raw pointers and references to objects of the map (from dereferencing a
+    /// Pointer, forEach, mutable lookup etc.) are not tracked either: writing
+    /// through ones obtained before the snapshot modifies the shared data, and
+    /// thus also the snapshot. Such handles need to be obtained again after
+    /// the snapshot. Taking a snapshot invalidates PointerViews of the map.
+    SmartMap snapshot() const;
+
     /// Get a pointer to object of specific type
     /// T: Data type
     /// K: Key type
@@ -91,123 +273,577 @@ public:
     template <typename T>
     Pointer<T> getPointer(const char* key);
 
-    /// TypeId is used to assign an id for each type stored in SmartMaps
+    /// Overload for std::string_view -> std::string mapping. Looking up an
+    /// existing key does not construct a temporary std::string.
+    template <typename T>
+    Pointer<T> getPointer(std::string_view key);
+
+    /// Find object of type T with key of type K without modifying the map,
+    /// returns nullptr in case the key doesn't exist. The returned pointer is
+    /// invalidated like PointerViews are.
+    template <typename T, typename K>
+    const T* find(const K& key) const;
+
+    /// Overload for string literal -> std::string mapping
+    template <typename T>
+    const T* find(const char* key) const;
+
+    /// Overload for std::string_view -> std::string mapping
+    template <typename T>
+    const T* find(std::string_view key) const;
+
+    /// Get pointers to objects of multiple keys at once, objects are created for
+    /// keys that don't exist. Storage is pre-sized once for all new keys and the
+    /// existing Pointers are updated at most once. Pointers are returned in the
+    /// order of the keys.
+    /// T: Data type
+    /// K: Key type
+    template <typename T, typename K>
+    std::vector<Pointer<T>> getPointers(std::span<const K> keys);
+
+    /// Find objects of multiple keys at once without modifying the map, out[i] is
+    /// set to the object of keys[i] or nullptr in case the key doesn't exist. The
+    /// lookups are pipelined with software prefetching, which hides the memory
+    /// latency on maps larger than the cache, and the found objects are
+    /// prefetched for the caller. The returned pointers are invalidated like
+    /// PointerViews are. keys and out must be of the same size.
+    /// T: Data type
+    /// K: Key type
+    template <typename T, typename K>
+    void lookup(std::span<const K> keys, std::span<const T*> out) const;
+
+    /// Overload for modifying the found objects, no objects are created
+    template <typename T, typename K>
+    void lookup(std::span<const K> keys, std::span<T*> out);
+
+    /// Overloads for std::string_view -> std::string mapping, the keys are
+    /// looked up without constructing std::strings
+    template <typename T>
+    void lookup(std::span<const std::string_view> keys, std::span<const T*> out) const;
+    template <typename T>
+    void lookup(std::span<const std::string_view> keys, std::span<T*> out);
+
+    /// Allocate storage for n objects of type T in total
+    template <typename T>
+    void reserve(std::size_t n);
+
+    /// Allocate storage for n objects of type T and n keys of type K in total
+    template <typename T, typename K>
+    void reserve(std::size_t n);
+
+    /// Erase key and the object mapped to it. The object is reset and its slot
+    /// is reused for new keys, pointers to the object get invalidated.
+    /// Returns true in case the key existed.
+    /// T: Data type
+    /// K: Key type
+    template <typename T, typename K>
+    bool erase(const K& key);
+
+    /// Overload for string literal -> std::string mapping
+    template <typename T>
+    bool erase(const char* key);
+
+    /// Overload for std::string_view -> std::string mapping
+    template <typename T>
+    bool erase(std::string_view key);
+
+    /// Call f(T&) for each object of type T. Objects are visited in storage
+    /// order, f must not insert or erase objects of type T.
+    template <typename T, typename F>
+    void forEach(F&& f);
+
+    /// Call f(const K&, T&) for each key of type K mapped to an object of type T.
+    /// Keys are visited in index order, f must not insert or erase objects of
+    /// type T.
+    template <typename T, typename K, typename F>
+    void forEachKey(F&& f);
+
+    /// Call f(T&) for each object of type T, with the storage partitioned into
+    /// contiguous ranges processed by nThreads threads (hardware concurrency by
+    /// default). f gets called concurrently, so it must be safe to call for
+    /// different objects from multiple threads. An exception thrown by f is
+    /// rethrown once all the threads have finished.
+    template <typename T, typename F>
+    void parallelForEach(F&& f, unsigned nThreads = 0);
+
+    /// Memory resource used for allocating the internal data
+    std::pmr::memory_resource* getMemoryResource() const noexcept;
+
+    /// Spelling of type T by the compiler, e.g. "int" or "std::vector<float>"
+    template <typename T>
+    static constexpr std::string_view compilerTypeName();
+
+    /// TypeId is used to assign an id for each type stored in SmartMaps. TypeIds
+    /// are dense indices assigned in the order the types are first used, so they
+    /// differ between processes and must not be persisted (see StableTypeId).
     using TypeId = unsigned;
 
-    /// Get TypeId of a specific type
+    /// Get TypeId of a specific type. Throws std::logic_error in case the
+    /// StableTypeId of the type collides with the one of another type in use.
     template <typename T>
     static TypeId getTypeId();
 
+    /// Statistics of the data of a single object type, see stats()
+    struct TypeStats {
+        TypeId              typeId;
+        std::string_view    typeName; // see TypeNameTraits
+        std::size_t         objects; // number of objects
+        std::size_t         slots; // number of object slots, including released ones
+        std::size_t         capacity; // number of object slots allocated
+        std::size_t         bytes; // bytes allocated for the slots, not including memory owned by the objects
+        std::size_t         pointers; // number of registered Pointers
+        std::size_t         keys; // number of keys of all key types
+        float               maxLoadFactor; // highest load factor of the IdMaps, see IndexTraits
+        std::uint64_t       invalidations; // number of pool reallocations requiring Pointer updates
+        std::uint64_t       updateNs; // total time spent updating the Pointers after the reallocations
+    };
+
+    /// Statistics of all object types stored in the map. Takes time proportional
+    /// to the number of Pointers and key types, the data is not modified. Index
+    /// maps without load_factor report 0 as their load factor. The invalidation
+    /// statistics are collected unless SMARTMAP_DISABLE_STATS is defined, in which
+    /// case they are 0.
+    std::vector<TypeStats> stats() const;
+
+    /// Name of type T used for computing its StableTypeId. By default the name is
+    /// the compiler's spelling of the type, which is stable between builds made
+    /// with the same compiler. Distinct types with the same spelling, such as
+    /// types of the same name in anonymous namespaces of different translation
+    /// units, collide: getTypeId throws std::logic_error for the second one used,
+    /// and load refuses to load either of them. Such types need an explicit
+    /// name. Specialize to register a name that is stable across compilers, or
+    /// to resolve a StableTypeId collision:
+    ///
+    ///     template <>
+    ///     struct SmartMap::TypeNameTraits<MyType> {
+    ///         static constexpr std::string_view name = "MyType";
+    ///     };
+    template <typename T>
+    struct TypeNameTraits {
+        static constexpr std::string_view name = compilerTypeName<T>();
+    };
+
+    /// Identifier of a type that is the same in all processes, the 64-bit FNV-1a
+    /// hash of the type name (see TypeNameTraits). Identifies types in saved files.
+    using StableTypeId = std::uint64_t;
+
+    /// Get StableTypeId of a specific type
+    template <typename T>
+    static constexpr StableTypeId getStableTypeId();
+
+    /// Hash and equality functors used for key type K. Transparent functors
+    /// (defining is_transparent) enable lookups with other types than K.
+    template <typename K>
+    struct KeyTraits {
+        using Hash = std::hash<K>;
+        using Equal = std::equal_to<K>;
+    };
+
+    /// Index type used for mapping keys of type K to objects, defaults to the
+    /// open-addressing FlatHashMap. Specialize to use another map type, which
+    /// needs to provide find, try_emplace, erase, reserve, size and iteration in
+    /// the manner of std::unordered_map. Maps using std::pmr::polymorphic_allocator
+    /// get allocated from the memory resource of the SmartMap:
+    ///
+    ///     template <>
+    ///     struct SmartMap::IndexTraits<MyKey> {
+    ///         template <typename V>
+    ///         using Map = std::pmr::unordered_map<MyKey, V>;
+    ///     };
+    template <typename K>
+    struct IndexTraits {
+        template <typename V>
+        using Map = FlatHashMap<K, V, typename KeyTraits<K>::Hash, typename KeyTraits<K>::Equal,
+            std::pmr::polymorphic_allocator<std::pair<K, V>>>;
+    };
+
+    /// Serialization of objects and keys of type T for save and load. By default
+    /// trivially copyable types are serializable and stored as raw bytes, which
+    /// allows MappedSmartMap to access them in place. Specialize to serialize
+    /// other types, or to disable serialization of trivially copyable types
+    /// containing pointers. All the members are required:
+    ///
+    ///     template <>
+    ///     struct SmartMap::SerializationTraits<MyType> {
+    ///         static constexpr bool serializable = true;
+    ///         static constexpr bool raw = false;
+    ///         static void write(std::ostream& out, const MyType& o);
+    ///         static void read(std::istream& in, MyType& o);
+    ///     };
+    template <typename T>
+    struct SerializationTraits {
+        static constexpr bool serializable = std::is_trivially_copyable_v<T>;
+        static constexpr bool raw = std::is_trivially_copyable_v<T>;
+
+        static void write(std::ostream& out, const T& o);
+        static void read(std::istream& in, T& o);
+    };
+
+    /// Save the map into a binary file. All object and key types stored in the
+    /// map need to be serializable (see SerializationTraits), otherwise
+    /// std::runtime_error is thrown. Files can only be read by programs built
+    /// for the same platform, since objects are stored in their native layout.
+    void save(const std::string& path) const;
+
+    /// Save the map into a binary stream. Arrays in the data are aligned
+    /// relative to the beginning of the stream, so it should be written from
+    /// position 0 to be accessible with MappedSmartMap.
+    void save(std::ostream& out) const;
+
+    /// Load a map saved with save. Types are identified by their names, and
+    /// need to be used with getPointer somewhere in the program to be known to
+    /// load. Throws std::runtime_error in case the file can't be loaded, which
+    /// includes truncated files and ones with inconsistent indices.
+    static SmartMap load(const std::string& path,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /// Load a map saved into a stream with save
+    static SmartMap load(std::istream& in,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
 private:
-    // Struct for pointers to functions required when copying or moving a SmartMap
-    // object. Since a SmartMap instance does not contain type information, type
-    // erasure mechanism provided by this struct is required.
+    // Transparent hash for std::string keys, allows lookups with std::string_view
+    // and string literals without constructing an std::string
+    struct StringHash {
+        using is_transparent = void;
+
+        inline std::size_t operator()(std::string_view key) const noexcept __attribute__((always_inline));
+    };
+
+    // Key -> object Id mapping for object type T and key type K
+    template <typename T, typename K>
+    using IdMap = typename IndexTraits<K>::template Map<Id<T>>;
+
+    // Type erased IdMap with pointers to functions required for copying and
+    // deleting it.
+    struct IdMapHelper {
+        void*   idMap; // Pointer to IdMap<T, K>
+        // Pointer to copyIdMap
+        void*   (*idMapCopier)(const void* idMap, std::pmr::memory_resource* resource);
+        // Pointer to deleteIdMap
+        void    (*idMapDeleter)(void* idMap, std::pmr::memory_resource* resource);
+        // Pointer to writeIdMap, nullptr in case the key type is not serializable
+        void    (*idMapWriter)(const void* idMap, std::ostream& out);
+        // Pointer to getIdMapStats
+        void    (*idMapStatsGetter)(const void* idMap, TypeStats& stats);
+
+        IdMapHelper() noexcept;
+    };
+
+    // All data of object type T stored in a single SmartMap instance
+    template <typename T>
+    struct TypeStorage {
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
+        // Allocator for all the data of the storage, including the storage itself
+        allocator_type              allocator;
+        // Objects of type T
+        ObjectPool<T>               pool;
+        // Head of the intrusive list of the registered Pointers, which is required
+        // for container <-> pointer syncing purposes. (See updatePointerObjectData
+        // and invalidatePointers)
+        Pointer<T>*                 pointers = nullptr;
+        // IdMaps for each key type, each stored at index specified by the key TypeId
+        std::pmr::vector<IdMapHelper>   idMaps;
+        // Incremented by operations invalidating PointerViews, including the
+        // destruction of the storage, used for detecting dereferencing of stale
+        // views in debug builds. Shared with the views so that it outlives the
+        // storage. Atomic since snapshots increment it on the shared storage,
+        // which can happen from several threads at once. Only relaxed ordering
+        // is needed.
+        std::shared_ptr<std::atomic<std::uint64_t>> viewEpoch;
+        // Incremented instead of updating the Pointers when the pool has been
+        // invalidated in case T uses lazy rebinding (see PointerTraits)
+        std::uint64_t               pointerEpoch = 0;
+        // Number of SmartMaps sharing the storage (see copyStorage)
+        mutable std::atomic<std::size_t>    refCount = 1;
+        // Mutex guarding the pointer list, see SmartMap::_pointerMutex
+        std::mutex*                 pointerMutex = nullptr;
+        // Statistics of the Pointer updates, see stats(). Members exist regardless
+        // of SMARTMAP_DISABLE_STATS to keep the layout the same in all builds.
+        std::uint64_t               invalidations = 0;
+        std::uint64_t               updateNs = 0;
+
+        explicit TypeStorage(const allocator_type& allocator);
+        // Copies pool and the IdMaps, pointer list of the copy is left empty since
+        // the existing Pointers keep pointing to the original storage
+        TypeStorage(const TypeStorage<T>& other, const allocator_type& allocator);
+        TypeStorage<T>& operator=(const TypeStorage<T>&) = delete;
+        ~TypeStorage();
+
+        // Access IdMap for key type K, creates it if it doesn't exist
+        template <typename K>
+        inline IdMap<T, K>& accessIdMap() __attribute__((always_inline));
+    };
+
+    // Struct for pointers to functions required when copying, moving or destroying
+    // a SmartMap object. Since a SmartMap instance does not contain type information,
+    // type erasure mechanism provided by this struct is required.
     struct TypeHelper {
-        // Pointer to updatePointerMapData
-        void (*pointerMapDataUpdater)(const SmartMap* oldMap, SmartMap* newMap);
-
-        // Pointer to movePool
-        void (*poolMover)(const SmartMap* oldMap, const SmartMap* newMap);
-        // Pointer to movePointerPool
-        void (*pointerPoolMover)(const SmartMap* oldMap, const SmartMap* newMap);
-        // Pointers to moveIdMaps (required for each key type K)
-        std::vector<void(*)(const SmartMap* oldMap, const SmartMap* newMap)> idMapMovers;
-
-        // Pointer to copyPool
-        void (*poolCopier)(const SmartMap* oldMap, const SmartMap* newMap);
-        // Pointer to copyPointerPool
-        void (*pointerPoolCopier)(const SmartMap* oldMap, const SmartMap* newMap);
-        // Pointers to copyIdMaps (required for each key type K)
-        std::vector<void(*)(const SmartMap* oldMap, const SmartMap* newMap)> idMapCopiers;
+        // Pointer to TypeStorage<T>, owned by the SmartMap
+        void*   storage;
+
+        // Pointer to invalidatePointers
+        void    (*pointerInvalidator)(void* storage);
+        // Pointer to copyStorage
+        void*   (*storageCopier)(const void* storage, std::pmr::memory_resource* resource, bool share);
+        // Pointer to deleteStorage
+        void    (*storageDeleter)(void* storage);
+        // Pointer to writeStorage, nullptr in case the object type is not serializable
+        void    (*storageWriter)(const void* storage, std::ostream& out);
+        // Pointer to getStorageStats
+        void    (*storageStatsGetter)(const void* storage, TypeStats& stats);
 
         TypeHelper() noexcept;
 
-        // Initialize TypeHelper for specified type
+        // Initialize TypeHelper and allocate the storage for specified type
         template <typename T>
-        inline void init() noexcept __attribute((always_inline));
-
-        // Add idMapMover for key type K
-        // Note: Make sure that object type T matches the other function pointers!
-        template <typename T, typename K>
-        inline void addIdMapFunctions() __attribute__((always_inline));
+        inline void init(std::pmr::memory_resource* resource, std::mutex* pointerMutex) __attribute((always_inline));
     };
 
     friend struct TypeHelper;
+    friend class ConcurrentSmartMap;
+    friend class MappedSmartMap;
+    template <typename... Types>
+    friend class StaticSmartMap;
+
+    // Type-indexed table of all data stored in the SmartMap instance. Each object
+    // is stored at index specified by the respective typeId (see getTypeId).
+    // Allocator of the table defines the memory resource of the SmartMap.
+    std::pmr::vector<TypeHelper>    _typeHelpers;
+
+    // Mutex guarding the pointer lists, only set for maps shared between threads
+    // (see ConcurrentSmartMap). Passed to the storages created by the map.
+    std::mutex*                     _pointerMutex = nullptr;
+
+    // Identifier of the file format, "SMAP" in little endian
+    static constexpr std::uint32_t  fileMagic = 0x50414d53;
+    static constexpr std::uint32_t  fileVersion = 3;
+    // Alignment of raw object and key arrays within the file, allows accessing
+    // them in place when the file is memory mapped
+    static constexpr std::size_t    fileArrayAlignment = 64;
+
+    // Number of types stored, throws std::runtime_error in case some of them are
+    // not serializable
+    std::uint64_t countSerializableTypes() const;
+
+    // Assign TypeId for type with stableTypeId and name, checks that no other
+    // type in use has the same StableTypeId
+    static TypeId registerType(StableTypeId stableTypeId, std::string_view name);
+
+    // Function loading TypeStorage or IdMap data from a file into a map. Loaders
+    // are registered by the StableTypeIds upon program startup for all object and
+    // key types the program uses (see TypeHelper::init and TypeStorage::accessIdMap),
+    // which lets load find them for types it doesn't know about at compile time.
+    // Types colliding with each other have a nullptr loader.
+    using Loader = void (*)(SmartMap& map, std::istream& in);
+
+    static std::unordered_map<StableTypeId, Loader>& storageLoaders();
+    // Keyed by StableTypeIds of the object and the key type
+    static std::map<std::pair<StableTypeId, StableTypeId>, Loader>& idMapLoaders();
+
+    template <typename T>
+    static bool registerStorageLoader();
+
+    template <typename T, typename K>
+    static bool registerIdMapLoader();
+
+    template <typename T>
+    static inline const bool storageLoaderRegistered = registerStorageLoader<T>();
+
+    template <typename T, typename K>
+    static inline const bool idMapLoaderRegistered = registerIdMapLoader<T, K>();
+
+    // Access IdMap of object type T and key type K, returns nullptr in case it
+    // doesn't exist
+    template <typename T, typename K>
+    inline IdMap<T, K>* findIdMap() const __attribute__((always_inline));
+
+    // Find Id of object with existing key, returns nullptr in case the key doesn't
+    // exist. The map is not modified, so the call is safe with concurrent findId
+    // calls. Key of type L is used to look up the IdMap of key type K, which
+    // requires transparent KeyTraits in case L differs from K.
+    template <typename T, typename K, typename L>
+    const Id<T>* findId(const L& key) const;
+
+    // Access the TypeStorage of type T, returns nullptr in case it doesn't exist
+    template <typename T>
+    inline TypeStorage<T>* findStorage() const __attribute__((always_inline));
 
-    // All TypeHelper objects required to move the SmartMap instance. Each object is
-    // stored at index specified by the respective typeId (see getTypeId).
-    std::vector<TypeHelper>   _typeHelpers;
+    // Access the TypeStorage of type T for modification, returns nullptr in case
+    // it doesn't exist. Detaches the storage in case it is shared.
+    template <typename T>
+    inline TypeStorage<T>* findMutableStorage() __attribute__((always_inline));
 
-    // Helper for assigning unique TypeId for each type
-    static TypeId typeIdCounter;
+    // Access the TypeStorage of type T for modification, creates it if it doesn't
+    // exist. Detaches the storage in case it is shared.
+    template <typename T>
+    inline TypeStorage<T>& accessStorage() __attribute__((always_inline));
 
-    // Static variable template storing the actual data and providing mapping
-    // from object type and SmartMap pointer to an ObjectPool instance. This enables
-    // heterogenous storage through templated interface.
+    // Replace shared TypeStorage of type T with a copy owned by this map only
     template <typename T>
-    static std::unordered_map<const SmartMap*, ObjectPool<T>> poolMap;
+    void detachStorage();
 
-    // Static template variable providing mapping from object type and SmartMap
-    // pointer to ObjectPool of pointers of corresponding type. This essentially
-    // stores pointers to Pointer objects, which are required for container <->
-    // pointer syncing purposes. (See updatePointer*Data functions)
+    // Access the TypeStorage of type T, which is required to exist and not to be
+    // shared in case it gets modified
     template <typename T>
-    static std::unordered_map<const SmartMap*, ObjectPool<Pointer<T>*>> pointerPoolMap;
+    inline TypeStorage<T>& storage() __attribute__((always_inline));
+
+    // Functions for type erased copying and deletion of TypeStorage objects.
+    // Pointers to these functions are stored in TypeHelper objects. In case share
+    // is set (see snapshot), storages without registered Pointers in the same
+    // memory resource are shared instead of copied. Deletion releases the
+    // reference and deletes the storage once it is no longer shared. Storages
+    // are deleted using the memory resource they were allocated from.
+    template <typename T>
+    static void* copyStorage(const void* storage, std::pmr::memory_resource* resource, bool share);
 
-    // In similar fashion to template variables above, this function provides mapping
-    // from key type and SmartMap pointer to ObjectPool Id:s. This enables usage of
-    // any type of key.
+    template <typename T>
+    static void deleteStorage(void* storage);
+
+    // Functions for type erased copying and deletion of IdMap objects.
+    // Pointers to these functions are stored in IdMapHelper objects.
     template <typename T, typename K>
-    static std::unordered_map<const SmartMap*, std::unordered_map<K, Id<T>>> idMapMap;
+    static void* copyIdMap(const void* idMap, std::pmr::memory_resource* resource);
 
-    // As SmartMap instances get moved/destructed, the data in *Map static variable
-    // templates is required to be reassigned to new key / erased from the maps.
-    // This function performs the reassign(use nullprt as newMap for erasure) for
-    // poolMap. Pointers to this function are stored in TypeHelper objects.
+    template <typename T, typename K>
+    static void deleteIdMap(void* idMap, std::pmr::memory_resource* resource);
+
+    // Functions for writing and loading TypeStorage and IdMap objects. Pointers
+    // to the writers are stored in TypeHelper and IdMapHelper objects, loaders
+    // are registered by the type names.
+    // File layout (integers are u64 unless stated otherwise, strings are the
+    // length followed by the characters):
+    //   magic (u32), version (u32), number of types, for each type:
+    //     StableTypeId of T, sizeof(T), number of slots n, raw flag
+    //     raw: padding to 64, T[n] / serialized: size in bytes, objects
+    //     padding to 8, activity bitmap of (n+63)/64 words, generations (u32[n])
+    //     number of IdMaps, for each IdMap:
+    //       StableTypeId of K, sizeof(K), number of keys m, raw flag
+    //       padding to 8, key hashes[m] (ascending), object ids[m]
+    //       raw: padding to 64, K[m] / serialized: offsets[m] to the keys,
+    //       size of the keys in bytes, keys
     template <typename T>
-    static void movePool(const SmartMap* oldMap, const SmartMap* newMap);
+    static void writeStorage(const void* storage, std::ostream& out);
 
-    // Similar to function above, performs reassign/erase for pointerPoolMap.
     template <typename T>
-    static void movePointerPool(const SmartMap* oldMap, const SmartMap* newMap);
+    static void loadStorage(SmartMap& map, std::istream& in);
+
+    template <typename T, typename K>
+    static void writeIdMap(const void* idMap, std::ostream& out);
 
-    // Similar to function above, performs reassign/erase for idMapMap.
     template <typename T, typename K>
-    static void moveIdMap(const SmartMap* oldMap, const SmartMap* newMap);
+    static void loadIdMap(SmartMap& map, std::istream& in);
 
-    // Similar to movePool but performs a copy instead of move.
+    // Functions for type erased collection of statistics, pointers to these
+    // functions are stored in TypeHelper and IdMapHelper objects. IdMap
+    // statistics get accumulated to the ones of the object type.
     template <typename T>
-    static void copyPool(const SmartMap* oldMap, const SmartMap* newMap);
+    static void getStorageStats(const void* storage, TypeStats& stats);
 
-    // Similar to movePointerPool but performs a copy instead of move.
+    template <typename T, typename K>
+    static void getIdMapStats(const void* idMap, TypeStats& stats);
+
+    // Helpers for reading and writing the file format, throw std::runtime_error
+    // on failure
+    static void writeRaw(std::ostream& out, const void* data, std::size_t size);
+    static void writeU64(std::ostream& out, std::uint64_t value);
+    static void writeString(std::ostream& out, std::string_view str);
+    // Pad the stream so that its position is a multiple of alignment
+    static void writePadding(std::ostream& out, std::size_t alignment);
+    static void readRaw(std::istream& in, void* data, std::size_t size);
+    static std::uint64_t readU64(std::istream& in);
+    static std::string readString(std::istream& in);
+    // Skip size bytes
+    static void skipRaw(std::istream& in, std::size_t size);
+    // Skip the padding written by writePadding
+    static void skipPadding(std::istream& in, std::size_t alignment);
+    // Throw in case in is known to hold less than n elements of size bytes,
+    // which prevents allocating for counts read from a corrupt file
+    static void checkAvailable(std::istream& in, std::uint64_t n, std::size_t size);
+    // Throw in case reading from in has failed, for checking custom deserializers
+    static void checkStream(std::istream& in);
+
+    // Take over data of other map using the _typeHelpers, leaves other empty.
+    // The maps must use the same memory resource, and this map must be empty.
+    void moveData(SmartMap& other) noexcept;
+
+    // Copy data of other map using the _typeHelpers, sharing the storages that
+    // can be shared in case share is set
+    void copyData(const SmartMap& other, bool share = false);
+
+    // Delete all data and invalidate the Pointers
+    void deleteData() noexcept;
+
+    // Erase key of type L from IdMap of key type K, see findId
+    template <typename T, typename K, typename L>
+    bool eraseKey(const L& key);
+
+    // Implementation of lookup with keys of type L in IdMap of key type K. P is
+    // ObjectPool<T> or const ObjectPool<T>, and O is T or const T respectively.
+    template <typename T, typename K, typename L, typename P, typename O>
+    static void lookupObjects(const IdMap<T, K>* idMap, P* pool, std::span<const L> keys, std::span<O*> out);
+
+    // Lock pointerMutex of storage in case it is set
     template <typename T>
-    static void copyPointerPool(const SmartMap* oldMap, const SmartMap* newMap);
+    static inline std::unique_lock<std::mutex> lockPointers(TypeStorage<T>& storage) __attribute__((always_inline));
 
-    // Similar to moveIdMap but performs a copy instead of move.
+    // Find the id of the object of key in storage, inserting a new object in
+    // case the key doesn't exist. Shared with StaticSmartMap, which only differs
+    // in how the storage is accessed.
     template <typename T, typename K>
-    static void copyIdMap(const SmartMap* oldMap, const SmartMap* newMap);
+    static Id<T> insertObject(TypeStorage<T>& storage, const K& key);
 
-    // Move data from old map to new map using the _typeHelpers
-    void moveData(const SmartMap* oldMap, SmartMap* newMap = nullptr);
+    // Reset object and return it to the pool of storage, which invalidates
+    // Pointers and PointerViews to it
+    template <typename T>
+    static void releaseObject(TypeStorage<T>& storage, Id<T> id);
 
-    // Copy data from old map to new map using the _typeHelpers
-    void copyData(const SmartMap* oldMap, const SmartMap* newMap = nullptr);
+    // Inform the storage about construction of a new pointer
+    template <typename T>
+    static void registerPointer(TypeStorage<T>& storage, Pointer<T>* p);
 
-    // Inform the SmartMap about construction of a new pointer
+    // Inform the storage about destruction of a pointer
     template <typename T>
-    Id<Pointer<T>*> registerPointer(Pointer<T>* p);
+    static void unregisterPointer(TypeStorage<T>& storage, Pointer<T>* p);
 
-    // Inform the SmartMap about destruction of a new pointer
+    // Replace a registered pointer with newP, which takes its place in the list
     template <typename T>
-    void unregisterPointer(Id<Pointer<T>*> pId);
+    static void replacePointer(TypeStorage<T>& storage, Pointer<T>* p, Pointer<T>* newP);
 
-    // Update object data in Pointers, probably due to ObjectPool invalidation
+    // Update object data in Pointers, probably due to ObjectPool invalidation.
+    // With lazy rebinding only the pointer epoch gets incremented.
     template <typename T>
-    void updatePointerObjectData();
+    static void updatePointerObjectData(TypeStorage<T>& storage);
 
-    // Update map data in Pointers, due to SmartMap move or destruction
+    // Detach the Pointers from the storage before its destruction, which
+    // invalidates them. Pointers are bound to the storages rather than the
+    // SmartMap, so moving a SmartMap doesn't need to visit them.
     template <typename T>
-    static void updatePointerMapData(const SmartMap* oldMap, SmartMap* newMap = nullptr);
+    static void invalidatePointers(void* storage);
+};
+
+
+template <>
+struct SmartMap::KeyTraits<std::string> {
+    using Hash = SmartMap::StringHash;
+    using Equal = std::equal_to<>;
+};
+
+// Compilers spell std::string differently
+template <>
+struct SmartMap::TypeNameTraits<std::string> {
+    static constexpr std::string_view name = "std::string";
+};
+
+// Strings are stored as the length followed by the characters
+template <>
+struct SmartMap::SerializationTraits<std::string> {
+    static constexpr bool serializable = true;
+    static constexpr bool raw = false;
+
+    static void write(std::ostream& out, const std::string& o);
+    static void read(std::istream& in, std::string& o);
 };
 
 
@@ -8,91 +8,201 @@
 // with this source code package.
 //
 
-// Definitions of SmartMap static member variable templates
 template <typename T>
-std::unordered_map<const SmartMap*, SmartMap::ObjectPool<T>> SmartMap::poolMap;
+SmartMap::ObjectPool<T>::ObjectPool(const allocator_type& allocator) :
+    objects     (allocator),
+    generations (allocator),
+    activeBits  (allocator),
+    inactiveIds (allocator)
+{
+}
 
 template <typename T>
-std::unordered_map<const SmartMap*, SmartMap::ObjectPool<SmartMap::Pointer<T>*>> SmartMap::pointerPoolMap;
+SmartMap::ObjectPool<T>::ObjectPool(const ObjectPool& other, const allocator_type& allocator) :
+    objects     (other.objects, allocator),
+    generations (other.generations, allocator),
+    activeBits  (other.activeBits, allocator),
+    inactiveIds (other.inactiveIds, allocator),
+    invalidated (other.invalidated)
+{
+}
 
-template <typename T, typename K>
-std::unordered_map<const SmartMap*, std::unordered_map<K, SmartMap::Id<T>>> SmartMap::idMapMap;
+template <typename T>
+SmartMap::Id<T> SmartMap::ObjectPool<T>::firstInactiveId()
+{
+    // Reuse the most recently released object if there is one
+    if (!inactiveIds.empty()) {
+        auto id = inactiveIds.back();
+        inactiveIds.pop_back();
+        activeBits[id / 64] |= std::uint64_t(1) << (id % 64);
+        return id;
+    }
 
+    // Otherwise append a new object, pointers and references are invalidated
+    // only in case the storage moved its objects
+    Id<T> id = objects.size();
+    auto capacity = objects.capacity();
+    auto generationsCapacity = generations.capacity();
+    if (id / 64 == activeBits.size())
+        activeBits.push_back(0);
+    generations.emplace_back(0);
+    try {
+        objects.emplace_back();
+    }
+    catch (...) {
+        generations.pop_back();
+        if (!stableAddresses && generations.capacity() != generationsCapacity)
+            invalidated = true;
+        throw;
+    }
+    if (!stableAddresses && (objects.capacity() != capacity ||
+        generations.capacity() != generationsCapacity))
+        invalidated = true;
+
+    activeBits[id / 64] |= std::uint64_t(1) << (id % 64);
+    return id;
+}
 
 template <typename T>
-SmartMap::ObjectPool<T>::Wrapper::Wrapper(bool active) :
-    active  (active)
+void SmartMap::ObjectPool<T>::reserve(std::size_t n)
 {
+    auto capacity = objects.capacity();
+    auto generationsCapacity = generations.capacity();
+    objects.reserve(n);
+    generations.reserve(n);
+    activeBits.reserve((n+63) / 64);
+    if (!stableAddresses && (objects.capacity() != capacity ||
+        generations.capacity() != generationsCapacity))
+        invalidated = true;
 }
 
 template <typename T>
-SmartMap::Id<T> SmartMap::ObjectPool<T>::firstInactiveId()
+void SmartMap::ObjectPool<T>::release(Id<T> id)
 {
-    // TODO implement caching for the first inactive object
-    // Using naive linear search for now
-    for (Id<T> i=0; i<data.size(); ++i) {
-        if (!data[i].active) {
-            // Activate the object and return its ID
-            data[i].active = true;
-            return i;
-        }
-    }
-
-    data.emplace_back(true);
-    invalidated = true;
-    return data.size()-1;
+    activeBits[id / 64] &= ~(std::uint64_t(1) << (id % 64));
+    ++generations[id];
+    inactiveIds.push_back(id);
 }
 
 template <typename T>
 T& SmartMap::ObjectPool<T>::operator[](Id<T> id)
 {
-    return data[id].o;
+    return objects[id];
+}
+
+template <typename T>
+const T& SmartMap::ObjectPool<T>::operator[](Id<T> id) const
+{
+    return objects[id];
+}
+
+template <typename T>
+bool SmartMap::ObjectPool<T>::isActive(Id<T> id) const
+{
+    return activeBits[id / 64] & (std::uint64_t(1) << (id % 64));
+}
+
+template <typename T>
+std::size_t SmartMap::ObjectPool<T>::size() const noexcept
+{
+    return objects.size();
+}
+
+template <typename T>
+template <typename F>
+void SmartMap::ObjectPool<T>::forEachActive(Id<T> begin, Id<T> end, F&& f) const
+{
+    if (begin >= end)
+        return;
+
+    // Bits outside the range are masked out from the first and the last word
+    auto firstWord = begin / 64;
+    auto lastWord = (end-1) / 64;
+    for (auto w=firstWord; w<=lastWord; ++w) {
+        auto bits = activeBits[w];
+        if (w == firstWord)
+            bits &= ~std::uint64_t(0) << (begin % 64);
+        if (w == lastWord && end % 64 != 0)
+            bits &= (std::uint64_t(1) << (end % 64)) - 1;
+
+        // Fully active words are common in dense pools, visit them without bit scanning
+        if (bits == ~std::uint64_t(0)) {
+            for (Id<T> i=w*64; i<w*64+64; ++i)
+                f(i);
+            continue;
+        }
+
+        while (bits != 0) {
+            f(Id<T>(w*64 + std::countr_zero(bits)));
+            bits &= bits-1;
+        }
+    }
 }
 
 template <typename T>
 SmartMap::Pointer<T>::Pointer() :
-    _map        (nullptr),
-    _objectId   (0),
-    _objectPtr  (nullptr),
-    _pointerId  (0)
+    _storage        (nullptr),
+    _objectId       (0),
+    _objectPtr      (nullptr),
+    _generationPtr  (nullptr),
+    _generation     (0),
+    _epoch          (0),
+    _prev           (nullptr),
+    _next           (nullptr)
 {
 }
 
 template <typename T>
 SmartMap::Pointer<T>::Pointer(const SmartMap::Pointer<T>& other) :
-    _map        (other._map),
-    _objectId   (other._objectId),
-    _objectPtr  (other._objectPtr),
-    _pointerId  (_map != nullptr ? _map->registerPointer(this) : 0)
+    _storage        (other._storage),
+    _objectId       (other._objectId),
+    _objectPtr      (other._objectPtr),
+    _generationPtr  (other._generationPtr),
+    _generation     (other._generation),
+    _epoch          (other._epoch),
+    _prev           (nullptr),
+    _next           (nullptr)
 {
+    if (_storage != nullptr)
+        registerPointer(*_storage, this);
 }
 
 template <typename T>
 SmartMap::Pointer<T>::Pointer(SmartMap::Pointer<T>&& other) noexcept :
-    _map        (other._map),
-    _objectId   (other._objectId),
-    _objectPtr  (other._objectPtr),
-    _pointerId  (_map != nullptr ? _map->registerPointer(this) : 0)
+    _storage        (other._storage),
+    _objectId       (other._objectId),
+    _objectPtr      (other._objectPtr),
+    _generationPtr  (other._generationPtr),
+    _generation     (other._generation),
+    _epoch          (other._epoch),
+    _prev           (nullptr),
+    _next           (nullptr)
 {
-    // Unregister the other pointer and set it to moved-from state
-    if (other._map != nullptr)
-        other._map->unregisterPointer<T>(other._pointerId);
-    other._map = nullptr;
+    // Take the place of the other pointer in the registry and set it to moved-from state
+    if (_storage != nullptr)
+        replacePointer(*_storage, &other, this);
+    other._storage = nullptr;
     other._objectPtr = nullptr;
+    other._generationPtr = nullptr;
 }
 
 template <typename T>
 SmartMap::Pointer<T>& SmartMap::Pointer<T>::operator=(const SmartMap::Pointer<T>& other)
 {
-    // Reregister the pointer in case the other pointer uses different SmartMap instance
-    if (_map != other._map && _map != nullptr) {
-        _map->unregisterPointer<T>(_pointerId);
-        _map = other._map;
-        _pointerId = _map->registerPointer<T>(this);
+    // Reregister the pointer in case the other pointer uses different storage
+    if (_storage != other._storage) {
+        if (_storage != nullptr)
+            unregisterPointer(*_storage, this);
+        _storage = other._storage;
+        if (_storage != nullptr)
+            registerPointer(*_storage, this);
     }
 
     _objectId = other._objectId;
     _objectPtr = other._objectPtr;
+    _generationPtr = other._generationPtr;
+    _generation = other._generation;
+    _epoch = other._epoch;
 
     return *this;
 }
@@ -100,21 +210,30 @@ SmartMap::Pointer<T>& SmartMap::Pointer<T>::operator=(const SmartMap::Pointer<T>
 template <typename T>
 SmartMap::Pointer<T>& SmartMap::Pointer<T>::operator=(SmartMap::Pointer<T>&& other) noexcept
 {
-    // Reregister the pointer in case the other pointer uses different SmartMap instance
-    if (_map != other._map && _map != nullptr) {
-        _map->unregisterPointer<T>(_pointerId);
-        _map = other._map;
-        _pointerId = _map->registerPointer<T>(this);
+    if (this == &other)
+        return *this;
+
+    // Reregister the pointer in case the other pointer uses different storage
+    if (_storage != other._storage) {
+        if (_storage != nullptr)
+            unregisterPointer(*_storage, this);
+        _storage = other._storage;
+        if (_storage != nullptr)
+            registerPointer(*_storage, this);
     }
 
     _objectId = other._objectId;
     _objectPtr = other._objectPtr;
+    _generationPtr = other._generationPtr;
+    _generation = other._generation;
+    _epoch = other._epoch;
 
     // Unregister the other pointer and set it to moved-from state
-    if (other._map != nullptr)
-        other._map->unregisterPointer<T>(other._pointerId);
-    other._map = nullptr;
+    if (other._storage != nullptr)
+        unregisterPointer(*other._storage, &other);
+    other._storage = nullptr;
     other._objectPtr = nullptr;
+    other._generationPtr = nullptr;
 
     return *this;
 }
@@ -122,200 +241,1074 @@ SmartMap::Pointer<T>& SmartMap::Pointer<T>::operator=(SmartMap::Pointer<T>&& oth
 template <typename T>
 SmartMap::Pointer<T>::~Pointer()
 {
-    if (_map != nullptr)
-        _map->unregisterPointer<T>(_pointerId);
+    if (_storage != nullptr)
+        unregisterPointer(*_storage, this);
 }
 
 template <typename T>
 T& SmartMap::Pointer<T>::operator*()
 {
+    if constexpr (PointerTraits<T>::lazyRebinding) {
+        // Resolve the object again in case the pool has been reallocated
+        if (_epoch != _storage->pointerEpoch) {
+            _objectPtr = &_storage->pool[_objectId];
+            _generationPtr = &_storage->pool.generations[_objectId];
+            _epoch = _storage->pointerEpoch;
+        }
+    }
+
     return *_objectPtr;
 }
 
 template <typename T>
-SmartMap::Pointer<T>::Pointer(SmartMap* m, Id<T> objectId, T *objectPtr) :
-    _map        (m),
-    _objectId   (objectId),
-    _objectPtr  (objectPtr),
-    _pointerId  (m->registerPointer(this))
+bool SmartMap::Pointer<T>::isValid() const noexcept
 {
+    // The cached generation pointer might be stale with lazy rebinding
+    if constexpr (PointerTraits<T>::lazyRebinding)
+        return _storage != nullptr && _storage->pool.generations[_objectId] == _generation;
+    else
+        return _storage != nullptr && *_generationPtr == _generation;
+}
+
+template <typename T>
+T* SmartMap::Pointer<T>::objectPtr() const
+{
+    if constexpr (PointerTraits<T>::lazyRebinding) {
+        if (_epoch != _storage->pointerEpoch)
+            return &_storage->pool[_objectId];
+    }
+
+    return _objectPtr;
+}
+
+template <typename T>
+SmartMap::Pointer<T>::Pointer(TypeStorage<T>& storage, Id<T> objectId) :
+    _storage        (&storage),
+    _objectId       (objectId),
+    _objectPtr      (&storage.pool[objectId]),
+    _generationPtr  (&storage.pool.generations[objectId]),
+    _generation     (*_generationPtr),
+    _epoch          (storage.pointerEpoch),
+    _prev           (nullptr),
+    _next           (nullptr)
+{
+    registerPointer(storage, this);
+}
+
+template <typename T>
+SmartMap::PointerView<T>::PointerView() noexcept :
+    _objectPtr  (nullptr)
+#ifndef NDEBUG
+    ,
+    _epoch      (nullptr),
+    _viewEpoch  (0)
+#endif
+{
+}
+
+template <typename T>
+SmartMap::PointerView<T>::PointerView(const Pointer<T>& pointer) noexcept :
+    _objectPtr  (pointer.isValid() ? pointer.objectPtr() : nullptr)
+#ifndef NDEBUG
+    ,
+    _epoch      (_objectPtr != nullptr ? pointer._storage->viewEpoch : nullptr),
+    _viewEpoch  (_epoch != nullptr ? _epoch->load(std::memory_order_relaxed) : 0)
+#endif
+{
+}
+
+template <typename T>
+T& SmartMap::PointerView<T>::operator*() const
+{
+#ifndef NDEBUG
+    assert(_objectPtr != nullptr && _epoch->load(std::memory_order_relaxed) == _viewEpoch &&
+        "Dereferencing invalid PointerView");
+#endif
+    return *_objectPtr;
 }
 
 template <typename T, typename K>
 typename SmartMap::Pointer<T> SmartMap::getPointer(const K& key)
 {
-    static const auto typeId = getTypeId<T>(); // object type id
+    // Access the storage designated to this SmartMap object
+    auto& storage = accessStorage<T>();
+    return Pointer<T>(storage, insertObject(storage, key));
+}
 
-    // Access the id map and object pool designated to this SmartMap object
-    auto& idMap = idMapMap<T, K>[this];
-    auto& pool = poolMap<T>[this];
+template <typename T, typename K>
+const T* SmartMap::find(const K& key) const
+{
+    auto* id = findId<T, K>(key);
+    if (id == nullptr)
+        return nullptr;
 
-    // If the key doesn't exist, create new key -> id mapping
-    if (idMap.find(key) == idMap.end()) {
-        // Resize the _typeHelpers vector if necessary (every entry stored to index specified by type id)
-        if (_typeHelpers.size() <= typeId)
-            _typeHelpers.resize(typeId+1);
+    return &findStorage<T>()->pool[*id];
+}
+
+template <typename T, typename K>
+void SmartMap::lookup(std::span<const K> keys, std::span<const T*> out) const
+{
+    const auto* s = findStorage<T>();
+    lookupObjects<T, K>(findIdMap<T, K>(), s != nullptr ? &s->pool : nullptr, keys, out);
+}
+
+template <typename T, typename K>
+void SmartMap::lookup(std::span<const K> keys, std::span<T*> out)
+{
+    // Shared storage needs to be detached before handing out mutable objects
+    auto* s = findMutableStorage<T>();
+    lookupObjects<T, K>(findIdMap<T, K>(), s != nullptr ? &s->pool : nullptr, keys, out);
+}
+
+template <typename T>
+void SmartMap::lookup(std::span<const std::string_view> keys, std::span<const T*> out) const
+{
+    const auto* s = findStorage<T>();
+    lookupObjects<T, std::string>(findIdMap<T, std::string>(), s != nullptr ? &s->pool : nullptr, keys, out);
+}
+
+template <typename T>
+void SmartMap::lookup(std::span<const std::string_view> keys, std::span<T*> out)
+{
+    auto* s = findMutableStorage<T>();
+    lookupObjects<T, std::string>(findIdMap<T, std::string>(), s != nullptr ? &s->pool : nullptr, keys, out);
+}
+
+template <typename T>
+const T* SmartMap::find(const char* key) const
+{
+    return find<T>(std::string_view(key));
+}
+
+template <typename T>
+const T* SmartMap::find(std::string_view key) const
+{
+    auto* id = findId<T, std::string>(key);
+    if (id == nullptr)
+        return nullptr;
+
+    return &findStorage<T>()->pool[*id];
+}
+
+template <typename T, typename K>
+std::vector<typename SmartMap::Pointer<T>> SmartMap::getPointers(std::span<const K> keys)
+{
+    auto& storage = accessStorage<T>();
+    auto& idMap = storage.template accessIdMap<K>();
+    auto& pool = storage.pool;
+
+    // Assume all the keys are new, the pool and IdMap get reallocated at most once
+    idMap.reserve(idMap.size() + keys.size());
+    pool.reserve(pool.size() - pool.inactiveIds.size() + keys.size());
+
+    // Insert all keys first, Pointers are created once all objects are in place
+    std::vector<Id<T>> ids;
+    ids.reserve(keys.size());
+    for (auto& key : keys) {
+        auto [it, inserted] = idMap.try_emplace(key, 0);
+        if (inserted) {
+            try {
+                it->second = pool.firstInactiveId();
+            }
+            catch (...) {
+                idMap.erase(it);
+                // Objects inserted so far might have moved
+                if (!ObjectPool<T>::stableAddresses && pool.invalidated)
+                    updatePointerObjectData(storage);
+                throw;
+            }
+        }
+        ids.push_back(it->second);
+    }
+
+    // Update the existing Pointers once for the whole batch
+    if (!ObjectPool<T>::stableAddresses && pool.invalidated)
+        updatePointerObjectData(storage);
+
+    // Pointers are bound in place, moving them into the vector would register
+    // each of them twice
+    std::vector<Pointer<T>> pointers(ids.size());
+    for (std::size_t i=0; i<ids.size(); ++i) {
+        auto& p = pointers[i];
+        p._objectId = ids[i];
+        p._objectPtr = &pool[ids[i]];
+        p._generationPtr = &pool.generations[ids[i]];
+        p._generation = *p._generationPtr;
+        p._epoch = storage.pointerEpoch;
+        p._storage = &storage;
+        registerPointer(storage, &p);
+    }
+
+    return pointers;
+}
+
+template <typename T>
+void SmartMap::reserve(std::size_t n)
+{
+    auto& storage = accessStorage<T>();
+    storage.pool.reserve(n);
+    if (!ObjectPool<T>::stableAddresses && storage.pool.invalidated)
+        updatePointerObjectData(storage);
+}
+
+template <typename T, typename K>
+void SmartMap::reserve(std::size_t n)
+{
+    reserve<T>(n);
+    storage<T>().template accessIdMap<K>().reserve(n);
+}
+
+template <typename T, typename K>
+SmartMap::IdMap<T, K>* SmartMap::findIdMap() const
+{
+    static const auto keyTypeId = getTypeId<K>(); // key type id
 
-        // Add the TypeHelper for the type if it is uninitialized
-        if (_typeHelpers[typeId].pointerMapDataUpdater == nullptr)
-            _typeHelpers[typeId].template init<T>();
+    // Only look up the existing data, nothing is created
+    const auto* s = findStorage<T>();
+    if (s == nullptr || s->idMaps.size() <= keyTypeId)
+        return nullptr;
 
-        // Add idMapMover for the key type
-        _typeHelpers[typeId].template addIdMapFunctions<T, K>();
+    return static_cast<IdMap<T, K>*>(s->idMaps[keyTypeId].idMap);
+}
 
-        auto newId = pool.firstInactiveId();
-        // The pool might have invalidated all pointers and references, forcing a Pointer update
-        if (pool.invalidated)
-            updatePointerObjectData<T>();
+template <typename T, typename K, typename L>
+const SmartMap::Id<T>* SmartMap::findId(const L& key) const
+{
+    const auto* idMap = findIdMap<T, K>();
+    if (idMap == nullptr)
+        return nullptr;
 
-        idMap[key] = newId;
-        return Pointer<T>(this, newId, &(pool[newId]));
+    auto it = idMap->find(key);
+    if (it == idMap->end())
+        return nullptr;
+
+    return &it->second;
+}
+
+template <typename T, typename K, typename L, typename P, typename O>
+void SmartMap::lookupObjects(const IdMap<T, K>* idMap, P* pool, std::span<const L> keys, std::span<O*> out)
+{
+    assert(keys.size() == out.size());
+
+    if (idMap == nullptr) {
+        std::fill(out.begin(), out.end(), nullptr);
+        return;
     }
 
-    // Return pointer for existing key
-    auto id = idMap.at(key);
-    return Pointer<T>(this, id, &(pool[id]));
+    // Index maps without batched find are looked up one key at a time
+    constexpr std::size_t batchSize = 16;
+    typename IdMap<T, K>::const_iterator its[batchSize];
+    for (std::size_t b=0; b<keys.size(); b+=batchSize) {
+        auto batch = keys.subspan(b, std::min(batchSize, keys.size()-b));
+        if constexpr (requires { idMap->find(batch, its); }) {
+            idMap->find(batch, its);
+        }
+        else {
+            for (std::size_t i=0; i<batch.size(); ++i)
+                its[i] = idMap->find(batch[i]);
+        }
+
+        for (std::size_t i=0; i<batch.size(); ++i) {
+            if (its[i] == idMap->end()) {
+                out[b+i] = nullptr;
+                continue;
+            }
+
+            out[b+i] = &(*pool)[its[i]->second];
+            __builtin_prefetch(out[b+i]);
+        }
+    }
 }
 
 template <typename T>
 typename SmartMap::Pointer<T> SmartMap::getPointer(const char* key)
 {
-    return getPointer<T, std::string>(key);
+    return getPointer<T>(std::string_view(key));
+}
+
+template <typename T>
+typename SmartMap::Pointer<T> SmartMap::getPointer(std::string_view key)
+{
+    // Look up with the std::string_view first, std::string is only required
+    // when a new key gets inserted
+    auto* id = findId<T, std::string>(key);
+    if (id != nullptr)
+        return Pointer<T>(accessStorage<T>(), *id);
+
+    return getPointer<T, std::string>(std::string(key));
+}
+
+template <typename T, typename K>
+bool SmartMap::erase(const K& key)
+{
+    return eraseKey<T, K>(key);
+}
+
+template <typename T>
+bool SmartMap::erase(const char* key)
+{
+    return eraseKey<T, std::string>(std::string_view(key));
+}
+
+template <typename T>
+bool SmartMap::erase(std::string_view key)
+{
+    return eraseKey<T, std::string>(key);
+}
+
+std::size_t SmartMap::StringHash::operator()(std::string_view key) const noexcept
+{
+    return std::hash<std::string_view>()(key);
+}
+
+template <typename T, typename F>
+void SmartMap::forEach(F&& f)
+{
+    auto* s = findMutableStorage<T>();
+    if (s == nullptr)
+        return;
+
+    auto& pool = s->pool;
+    pool.forEachActive(0, pool.size(), [&](Id<T> id) { f(pool[id]); });
+}
+
+template <typename T, typename K, typename F>
+void SmartMap::forEachKey(F&& f)
+{
+    auto* idMap = findIdMap<T, K>();
+    if (idMap == nullptr)
+        return;
+
+    auto& pool = findMutableStorage<T>()->pool;
+    idMap = findIdMap<T, K>();
+    for (auto& [key, id] : *idMap)
+        f(static_cast<const K&>(key), pool[id]);
+}
+
+template <typename T, typename F>
+void SmartMap::parallelForEach(F&& f, unsigned nThreads)
+{
+    auto* s = findMutableStorage<T>();
+    if (s == nullptr)
+        return;
+
+    auto& pool = s->pool;
+    if (nThreads == 0)
+        nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    nThreads = (unsigned)std::min<std::size_t>(nThreads, pool.size());
+    if (nThreads == 0)
+        return;
+
+    // Process range of slots, the first exception thrown is stored
+    std::exception_ptr exception;
+    std::mutex exceptionMutex;
+    auto process = [&](Id<T> begin, Id<T> end) {
+        try {
+            pool.forEachActive(begin, end, [&](Id<T> id) { f(pool[id]); });
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(exceptionMutex);
+            if (!exception)
+                exception = std::current_exception();
+        }
+    };
+
+    // Split the slots into contiguous ranges of roughly equal size, aligned to
+    // the bitmap words. The calling thread processes the last one.
+    auto rangeBegin = [&](unsigned t) { return pool.size()*t / nThreads / 64 * 64; };
+    std::vector<std::thread> threads;
+    threads.reserve(nThreads);
+    unsigned t = 0;
+    try {
+        for (; t+1<nThreads; ++t)
+            threads.emplace_back(process, rangeBegin(t), rangeBegin(t+1));
+    }
+    catch (const std::system_error&) {
+        // Thread could not be started, rest of the slots are processed by the calling thread
+    }
+    process(rangeBegin(t), pool.size());
+
+    for (auto& thread : threads)
+        thread.join();
+
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+template <typename T>
+constexpr std::string_view SmartMap::compilerTypeName()
+{
+    // The type is extracted from the signature of this function, e.g.
+    // "... compilerTypeName() [with T = int; ...]" (GCC) or "... [T = int]" (Clang)
+    std::string_view signature = __PRETTY_FUNCTION__;
+    auto begin = signature.find("T = ") + 4;
+    auto end = signature.find(';', begin);
+    if (end == std::string_view::npos)
+        end = signature.rfind(']');
+    return signature.substr(begin, end-begin);
 }
 
 template <typename T>
 SmartMap::TypeId SmartMap::getTypeId()
 {
-    static TypeId typeIdCounter = 0;
-    return typeIdCounter++;
+    static const TypeId typeId = registerType(getStableTypeId<T>(), TypeNameTraits<T>::name);
+    return typeId;
+}
+
+template <typename T>
+constexpr SmartMap::StableTypeId SmartMap::getStableTypeId()
+{
+    // 64-bit FNV-1a
+    StableTypeId hash = 0xcbf29ce484222325;
+    for (char c : TypeNameTraits<T>::name) {
+        hash ^= (unsigned char)c;
+        hash *= 0x100000001b3;
+    }
+    return hash;
 }
 
 template <typename T>
-void SmartMap::TypeHelper::init() noexcept
+SmartMap::TypeStorage<T>::TypeStorage(const allocator_type& allocator) :
+    allocator   (allocator),
+    pool        (allocator),
+    idMaps      (allocator),
+    viewEpoch   (std::allocate_shared<std::atomic<std::uint64_t>>(allocator, 0))
 {
-    pointerMapDataUpdater = &updatePointerMapData<T>;
-    poolMover = &movePool<T>;
-    pointerPoolMover = &movePointerPool<T>;
-    poolCopier = &copyPool<T>;
-    pointerPoolCopier = &copyPointerPool<T>;
 }
 
-template <typename T, typename K>
-void SmartMap::TypeHelper::addIdMapFunctions()
+template <typename T>
+SmartMap::TypeStorage<T>::TypeStorage(const SmartMap::TypeStorage<T>& other, const allocator_type& allocator) :
+    allocator   (allocator),
+    pool        (other.pool, allocator),
+    idMaps      (other.idMaps, allocator),
+    viewEpoch   (std::allocate_shared<std::atomic<std::uint64_t>>(allocator, 0))
 {
-    static const auto typeId = getTypeId<K>(); // key type id
+    // Replace the IdMaps of the other storage with copies
+    for (auto& m : idMaps)
+        m.idMap = nullptr;
 
-    // Resize the idMapMovers vector if necessary
-    if (idMapMovers.size() <= typeId)
-        idMapMovers.resize(typeId+1, nullptr);
+    try {
+        for (std::size_t i=0; i<idMaps.size(); ++i) {
+            if (other.idMaps[i].idMap != nullptr)
+                idMaps[i].idMap = other.idMaps[i].idMapCopier(other.idMaps[i].idMap, allocator.resource());
+        }
+    }
+    catch (...) {
+        // Destructor won't be called for partially constructed object
+        for (auto& m : idMaps)
+            if (m.idMap != nullptr)
+                m.idMapDeleter(m.idMap, allocator.resource());
+        throw;
+    }
+}
 
-    // Add the idMapMover for the type if it doesn't exist
-    if (idMapMovers[typeId] == nullptr)
-        idMapMovers[typeId] = &SmartMap::moveIdMap<T, K>;
+template <typename T>
+SmartMap::TypeStorage<T>::~TypeStorage()
+{
+    viewEpoch->fetch_add(1, std::memory_order_relaxed);
+    for (auto& m : idMaps)
+        if (m.idMap != nullptr)
+            m.idMapDeleter(m.idMap, allocator.resource());
+}
+
+template <typename T>
+template <typename K>
+SmartMap::IdMap<T, K>& SmartMap::TypeStorage<T>::accessIdMap()
+{
+    static const auto typeId = getTypeId<K>(); // key type id
 
-    // Resize the idMapCopiers vector if necessary
-    if (idMapCopiers.size() <= typeId)
-        idMapCopiers.resize(typeId+1, nullptr);
+    // Resize the idMaps vector if necessary (every entry stored to index specified by type id)
+    if (idMaps.size() <= typeId)
+        idMaps.resize(typeId+1);
 
-    // Add the idMapCopier for the type if it doesn't exist
-    if (idMapCopiers[typeId] == nullptr)
-        idMapCopiers[typeId] = &SmartMap::copyIdMap<T, K>;
+    // Create the IdMap if it doesn't exist
+    auto& m = idMaps[typeId];
+    if (m.idMap == nullptr) {
+        m.idMap = allocator.template new_object<IdMap<T, K>>();
+        m.idMapCopier = &copyIdMap<T, K>;
+        m.idMapDeleter = &deleteIdMap<T, K>;
+        m.idMapStatsGetter = &getIdMapStats<T, K>;
+        if constexpr (SerializationTraits<T>::serializable && SerializationTraits<K>::serializable) {
+            m.idMapWriter = &writeIdMap<T, K>;
+            (void)idMapLoaderRegistered<T, K>;
+        }
+    }
+
+    return *static_cast<IdMap<T, K>*>(m.idMap);
 }
 
 template <typename T>
-void SmartMap::movePool(const SmartMap* oldMap, const SmartMap* newMap)
+void SmartMap::TypeHelper::init(std::pmr::memory_resource* resource, std::mutex* pointerMutex)
 {
-    if (newMap == nullptr) {
-        poolMap<T>.erase(oldMap);
+    auto* s = std::pmr::polymorphic_allocator<>(resource).new_object<TypeStorage<T>>();
+    s->pointerMutex = pointerMutex;
+    storage = s;
+    pointerInvalidator = &invalidatePointers<T>;
+    storageCopier = &copyStorage<T>;
+    storageDeleter = &deleteStorage<T>;
+    storageStatsGetter = &getStorageStats<T>;
+    if constexpr (SerializationTraits<T>::serializable) {
+        storageWriter = &writeStorage<T>;
+        (void)storageLoaderRegistered<T>;
     }
-    else {
-        auto poolNode = poolMap<T>.extract(oldMap);
-        poolNode.key() = newMap;
-        poolMap<T>.insert(std::move(poolNode));
+}
+
+template <typename T>
+SmartMap::TypeStorage<T>* SmartMap::findStorage() const
+{
+    static const auto typeId = getTypeId<T>(); // object type id
+
+    if (_typeHelpers.size() <= typeId)
+        return nullptr;
+
+    return static_cast<TypeStorage<T>*>(_typeHelpers[typeId].storage);
+}
+
+template <typename T>
+SmartMap::TypeStorage<T>* SmartMap::findMutableStorage()
+{
+    auto* s = findStorage<T>();
+    if (s != nullptr && s->refCount.load(std::memory_order_acquire) > 1) {
+        detachStorage<T>();
+        s = findStorage<T>();
     }
+
+    return s;
 }
 
 template <typename T>
-void SmartMap::movePointerPool(const SmartMap* oldMap, const SmartMap* newMap)
+SmartMap::TypeStorage<T>& SmartMap::accessStorage()
 {
-    if (newMap == nullptr) {
-        pointerPoolMap<T>.erase(oldMap);
+    static const auto typeId = getTypeId<T>(); // object type id
+
+    if (_typeHelpers.size() <= typeId || _typeHelpers[typeId].storage == nullptr) {
+        // Resize the _typeHelpers vector if necessary (every entry stored to index specified by type id)
+        if (_typeHelpers.size() <= typeId)
+            _typeHelpers.resize(typeId+1);
+
+        // Add the TypeHelper and storage for the type if it is uninitialized
+        if (_typeHelpers[typeId].storage == nullptr)
+            _typeHelpers[typeId].template init<T>(getMemoryResource(), _pointerMutex);
     }
-    else {
-        auto pointerPoolNode = pointerPoolMap<T>.extract(oldMap);
-        pointerPoolNode.key() = newMap;
-        pointerPoolMap<T>.insert(std::move(pointerPoolNode));
+
+    return *findMutableStorage<T>();
+}
+
+template <typename T>
+void SmartMap::detachStorage()
+{
+    static const auto typeId = getTypeId<T>(); // object type id
+
+    // Shared storages have no registered Pointers, so nothing needs to be updated
+    auto* shared = static_cast<TypeStorage<T>*>(_typeHelpers[typeId].storage);
+    auto* detached = std::pmr::polymorphic_allocator<>(getMemoryResource())
+        .new_object<TypeStorage<T>>(*shared);
+    detached->pointerMutex = _pointerMutex;
+    _typeHelpers[typeId].storage = detached;
+    deleteStorage<T>(shared);
+}
+
+template <typename T>
+SmartMap::TypeStorage<T>& SmartMap::storage()
+{
+    static const auto typeId = getTypeId<T>(); // object type id
+    return *static_cast<TypeStorage<T>*>(_typeHelpers[typeId].storage);
+}
+
+template <typename T>
+void* SmartMap::copyStorage(const void* storage, std::pmr::memory_resource* resource, bool share)
+{
+    auto* s = static_cast<const TypeStorage<T>*>(storage);
+
+    // Objects can be modified through registered Pointers without the map knowing
+    // about it, so only storages without them can be shared. PointerViews can't
+    // be tracked, so they get invalidated.
+    if (share && s->pointers == nullptr &&
+        s->allocator.resource()->is_equal(*resource)) {
+        s->refCount.fetch_add(1, std::memory_order_relaxed);
+        s->viewEpoch->fetch_add(1, std::memory_order_relaxed);
+        return const_cast<TypeStorage<T>*>(s);
     }
+
+    return std::pmr::polymorphic_allocator<>(resource).new_object<TypeStorage<T>>(*s);
+}
+
+template <typename T>
+void SmartMap::deleteStorage(void* storage)
+{
+    auto* s = static_cast<TypeStorage<T>*>(storage);
+    if (s->refCount.fetch_sub(1, std::memory_order_acq_rel) > 1)
+        return;
+
+    auto allocator = s->allocator;
+    allocator.delete_object(s);
 }
 
 template <typename T, typename K>
-void SmartMap::moveIdMap(const SmartMap* oldMap, const SmartMap* newMap)
+void* SmartMap::copyIdMap(const void* idMap, std::pmr::memory_resource* resource)
+{
+    // Maps with a polymorphic allocator get constructed with the resource, see
+    // uses-allocator construction
+    return std::pmr::polymorphic_allocator<>(resource).new_object<IdMap<T, K>>(
+        *static_cast<const IdMap<T, K>*>(idMap));
+}
+
+template <typename T, typename K>
+void SmartMap::deleteIdMap(void* idMap, std::pmr::memory_resource* resource)
+{
+    std::pmr::polymorphic_allocator<>(resource).delete_object(static_cast<IdMap<T, K>*>(idMap));
+}
+
+template <typename T, typename K, typename L>
+bool SmartMap::eraseKey(const L& key)
+{
+    // Check for the key first so that shared storage doesn't get detached in vain
+    if (findId<T, K>(key) == nullptr)
+        return false;
+
+    findMutableStorage<T>();
+    auto* idMap = findIdMap<T, K>();
+    auto it = idMap->find(key);
+
+    auto id = it->second;
+    idMap->erase(it);
+    releaseObject(storage<T>(), id);
+
+    return true;
+}
+
+template <typename T, typename K>
+SmartMap::Id<T> SmartMap::insertObject(TypeStorage<T>& storage, const K& key)
+{
+    auto& idMap = storage.template accessIdMap<K>();
+    auto& pool = storage.pool;
+
+    // Single probe for both existing and new keys
+    auto [it, inserted] = idMap.try_emplace(key, 0);
+
+    // If the key didn't exist, assign new id for the object
+    if (inserted) {
+        try {
+            it->second = pool.firstInactiveId();
+        }
+        catch (...) {
+            idMap.erase(it);
+            throw;
+        }
+
+        // The pool might have invalidated all pointers and references, forcing a Pointer update.
+        // Never the case for stable storage, so the update can be skipped at compile time.
+        if (!ObjectPool<T>::stableAddresses && pool.invalidated)
+            updatePointerObjectData(storage);
+    }
+
+    return it->second;
+}
+
+template <typename T>
+void SmartMap::releaseObject(TypeStorage<T>& s, Id<T> id)
+{
+    // Reset the object so that the resources held by it get released. Releasing
+    // increments the slot generation, so Pointers to the object become invalid
+    // without having to be visited.
+    s.pool[id] = T();
+    s.pool.release(id);
+    s.viewEpoch->fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename T>
+std::unique_lock<std::mutex> SmartMap::lockPointers(TypeStorage<T>& storage)
+{
+    if (storage.pointerMutex == nullptr)
+        return std::unique_lock<std::mutex>();
+
+    return std::unique_lock<std::mutex>(*storage.pointerMutex);
+}
+
+template <typename T>
+void SmartMap::registerPointer(TypeStorage<T>& storage, SmartMap::Pointer<T>* p)
+{
+    auto lock = lockPointers(storage);
+
+    // Link the pointer to the front of the list
+    p->_prev = nullptr;
+    p->_next = storage.pointers;
+    if (storage.pointers != nullptr)
+        storage.pointers->_prev = p;
+    storage.pointers = p;
+}
+
+template <typename T>
+void SmartMap::unregisterPointer(TypeStorage<T>& storage, SmartMap::Pointer<T>* p)
 {
-    if (newMap == nullptr) {
-        idMapMap<T,K>.erase(oldMap);
+    auto lock = lockPointers(storage);
+
+    if (p->_prev != nullptr)
+        p->_prev->_next = p->_next;
+    else
+        storage.pointers = p->_next;
+    if (p->_next != nullptr)
+        p->_next->_prev = p->_prev;
+}
+
+template <typename T>
+void SmartMap::replacePointer(TypeStorage<T>& storage, SmartMap::Pointer<T>* p, SmartMap::Pointer<T>* newP)
+{
+    auto lock = lockPointers(storage);
+
+    newP->_prev = p->_prev;
+    newP->_next = p->_next;
+    if (p->_prev != nullptr)
+        p->_prev->_next = newP;
+    else
+        storage.pointers = newP;
+    if (p->_next != nullptr)
+        p->_next->_prev = newP;
+}
+
+template <typename T>
+void SmartMap::updatePointerObjectData(TypeStorage<T>& s)
+{
+#ifndef SMARTMAP_DISABLE_STATS
+    auto begin = std::chrono::steady_clock::now();
+#endif
+
+    // Fetch new addresses of the objects and update the Pointers. Invalidated
+    // Pointers get updated as well, their generation still won't match.
+    if constexpr (PointerTraits<T>::lazyRebinding) {
+        ++s.pointerEpoch;
     }
     else {
-        auto idMapNode = idMapMap<T,K>.extract(oldMap);
-        idMapNode.key() = newMap;
-        idMapMap<T,K>.insert(std::move(idMapNode));
+        for (auto* p = s.pointers; p != nullptr; p = p->_next) {
+            p->_objectPtr = &s.pool[p->_objectId];
+            p->_generationPtr = &s.pool.generations[p->_objectId];
+        }
     }
+
+    // PointerViews are not tracked, they become stale
+    s.viewEpoch->fetch_add(1, std::memory_order_relaxed);
+    s.pool.invalidated = false;
+
+#ifndef SMARTMAP_DISABLE_STATS
+    ++s.invalidations;
+    s.updateNs += (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+#endif
 }
 
-template<typename T>
-void SmartMap::copyPool(const SmartMap* oldMap, const SmartMap* newMap)
+template <typename T>
+void SmartMap::invalidatePointers(void* storage)
 {
-    poolMap<T>[newMap] = poolMap<T>[oldMap];
+    auto* s = static_cast<TypeStorage<T>*>(storage);
+
+    // Unlinking the pointers is not required as the list gets destroyed
+    for (auto* p = s->pointers; p != nullptr; p = p->_next)
+        p->_storage = nullptr;
+    s->pointers = nullptr;
 }
 
-template<typename T>
-void SmartMap::copyPointerPool(const SmartMap* oldMap, const SmartMap* newMap)
+template <typename T>
+void SmartMap::getStorageStats(const void* storage, TypeStats& stats)
 {
-    pointerPoolMap<T>[newMap] = pointerPoolMap<T>[oldMap];
+    auto* s = static_cast<const TypeStorage<T>*>(storage);
+    auto& pool = s->pool;
+
+    stats.typeName = TypeNameTraits<T>::name;
+    stats.objects = pool.size() - pool.inactiveIds.size();
+    stats.slots = pool.size();
+    stats.capacity = pool.objects.capacity();
+    stats.bytes = pool.objects.capacity()*sizeof(T) + pool.generations.capacity()*sizeof(std::uint32_t) +
+        pool.activeBits.capacity()*sizeof(std::uint64_t) + pool.inactiveIds.capacity()*sizeof(Id<T>);
+    stats.invalidations = s->invalidations;
+    stats.updateNs = s->updateNs;
+
+    {
+        auto lock = lockPointers(const_cast<TypeStorage<T>&>(*s));
+        stats.pointers = 0;
+        for (auto* p = s->pointers; p != nullptr; p = p->_next)
+            ++stats.pointers;
+    }
+
+    stats.keys = 0;
+    stats.maxLoadFactor = 0.0f;
+    for (auto& m : s->idMaps) {
+        if (m.idMap != nullptr)
+            m.idMapStatsGetter(m.idMap, stats);
+    }
 }
 
-template<typename T, typename K>
-void SmartMap::copyIdMap(const SmartMap* oldMap, const SmartMap* newMap)
+template <typename T, typename K>
+void SmartMap::getIdMapStats(const void* idMap, TypeStats& stats)
 {
-    idMapMap<T,K>[newMap] = idMapMap<T,K>[oldMap];
+    auto* m = static_cast<const IdMap<T, K>*>(idMap);
+    stats.keys += m->size();
+    if constexpr (requires { m->load_factor(); })
+        stats.maxLoadFactor = std::max(stats.maxLoadFactor, (float)m->load_factor());
 }
 
 template <typename T>
-SmartMap::Id<SmartMap::Pointer<T>*>
-SmartMap::registerPointer(SmartMap::Pointer<T>* p)
+void SmartMap::SerializationTraits<T>::write(std::ostream& out, const T& o)
 {
-    auto& pointerPool = pointerPoolMap<T>[this];
+    writeRaw(out, &o, sizeof(T));
+}
 
-    // Add the new pointer to the pool
-    Id<Pointer<T>*> id = pointerPool.firstInactiveId();
-    pointerPool[id] = p;
+template <typename T>
+void SmartMap::SerializationTraits<T>::read(std::istream& in, T& o)
+{
+    readRaw(in, &o, sizeof(T));
+}
 
-    return id;
+template <typename T>
+bool SmartMap::registerStorageLoader()
+{
+    // Loaders of different types with the same StableTypeId can't be told apart,
+    // the entry is cleared so that load refuses to load either of them
+    auto [it, inserted] = storageLoaders().try_emplace(getStableTypeId<T>(), &loadStorage<T>);
+    if (!inserted && it->second != &loadStorage<T>)
+        it->second = nullptr;
+    return true;
+}
+
+template <typename T, typename K>
+bool SmartMap::registerIdMapLoader()
+{
+    auto [it, inserted] = idMapLoaders().try_emplace({ getStableTypeId<T>(), getStableTypeId<K>() },
+        &loadIdMap<T, K>);
+    if (!inserted && it->second != &loadIdMap<T, K>)
+        it->second = nullptr;
+    return true;
 }
 
 template <typename T>
-void SmartMap::unregisterPointer(SmartMap::Id<SmartMap::Pointer<T>*> pId)
+void SmartMap::writeStorage(const void* storage, std::ostream& out)
 {
-    pointerPoolMap<T>[this].data[pId].active = false;
+    using Traits = SerializationTraits<T>;
+    auto& s = *static_cast<const TypeStorage<T>*>(storage);
+    auto& pool = s.pool;
+    auto n = pool.size();
+
+    writeU64(out, getStableTypeId<T>());
+    writeU64(out, sizeof(T));
+    writeU64(out, n);
+    writeU64(out, Traits::raw);
+
+    // Chunked arrays are written a chunk at a time
+    constexpr std::size_t chunkSize = StorageTraits<T>::chunkSize;
+    // Raw objects are stored as an aligned array, serialized ones are preceded
+    // by their total size so that readers can skip them
+    if constexpr (Traits::raw) {
+        writePadding(out, fileArrayAlignment);
+        if constexpr (ObjectPool<T>::stableAddresses) {
+            for (Id<T> i=0; i<n; i+=chunkSize)
+                writeRaw(out, &pool.objects[i], std::min<std::size_t>(chunkSize, n-i)*sizeof(T));
+        }
+        else
+            writeRaw(out, pool.objects.data(), n*sizeof(T));
+    }
+    else {
+        std::ostringstream objects;
+        for (Id<T> i=0; i<n; ++i)
+            Traits::write(objects, pool.objects[i]);
+        auto data = objects.str();
+        writeU64(out, data.size());
+        writeRaw(out, data.data(), data.size());
+    }
+
+    writePadding(out, sizeof(std::uint64_t));
+    writeRaw(out, pool.activeBits.data(), (n+63)/64 * sizeof(std::uint64_t));
+    if constexpr (ObjectPool<T>::stableAddresses) {
+        for (Id<T> i=0; i<n; i+=chunkSize)
+            writeRaw(out, &pool.generations[i], std::min<std::size_t>(chunkSize, n-i)*sizeof(std::uint32_t));
+    }
+    else
+        writeRaw(out, pool.generations.data(), n*sizeof(std::uint32_t));
+
+    std::uint64_t nIdMaps = 0;
+    for (auto& m : s.idMaps) {
+        if (m.idMap == nullptr)
+            continue;
+        if (m.idMapWriter == nullptr)
+            throw std::runtime_error(std::string("SmartMap::save: key type of object type ") +
+                std::string(TypeNameTraits<T>::name) + " is not serializable");
+        ++nIdMaps;
+    }
+
+    writeU64(out, nIdMaps);
+    for (auto& m : s.idMaps)
+        if (m.idMap != nullptr)
+            m.idMapWriter(m.idMap, out);
 }
 
 template <typename T>
-void SmartMap::updatePointerObjectData()
+void SmartMap::loadStorage(SmartMap& map, std::istream& in)
 {
-    auto& pool = poolMap<T>[this];
+    using Traits = SerializationTraits<T>;
+
+    auto objectSize = readU64(in);
+    auto n = readU64(in);
+    auto raw = readU64(in);
+    if (objectSize != sizeof(T) || raw != Traits::raw)
+        throw std::runtime_error(std::string("SmartMap::load: stored layout of type ") +
+            std::string(TypeNameTraits<T>::name) + " differs");
 
-    // Fetch new addresses of the objects and update the Pointers
-    for (auto& p : pointerPoolMap<T>[this].data)
-        if (p.active)
-            p.o->_objectPtr = &pool[p.o->_objectId];
+    auto& s = map.accessStorage<T>();
+    auto& pool = s.pool;
+    if (pool.size() != 0)
+        throw std::runtime_error(std::string("SmartMap::load: type ") +
+            std::string(TypeNameTraits<T>::name) + " is stored more than once");
+    // Each slot takes at least its generation and, if raw, the object
+    checkAvailable(in, n, sizeof(std::uint32_t) + (Traits::raw ? sizeof(T) : 0));
+    pool.reserve(n);
+    if constexpr (ObjectPool<T>::stableAddresses) {
+        for (Id<T> i=0; i<n; ++i) {
+            pool.objects.emplace_back();
+            pool.generations.emplace_back(0);
+        }
+    }
+    else {
+        pool.objects.resize(n);
+        pool.generations.resize(n);
+    }
+
+    // Chunked arrays are read a chunk at a time
+    constexpr std::size_t chunkSize = StorageTraits<T>::chunkSize;
+    if constexpr (Traits::raw) {
+        skipPadding(in, fileArrayAlignment);
+        if constexpr (ObjectPool<T>::stableAddresses) {
+            for (Id<T> i=0; i<n; i+=chunkSize)
+                readRaw(in, &pool.objects[i], std::min<std::size_t>(chunkSize, n-i)*sizeof(T));
+        }
+        else
+            readRaw(in, pool.objects.data(), n*sizeof(T));
+    }
+    else {
+        readU64(in); // size of the serialized objects
+        for (Id<T> i=0; i<n; ++i)
+            Traits::read(in, pool.objects[i]);
+        checkStream(in);
+    }
+
+    skipPadding(in, sizeof(std::uint64_t));
+    pool.activeBits.resize((n+63)/64);
+    readRaw(in, pool.activeBits.data(), pool.activeBits.size() * sizeof(std::uint64_t));
+    // Bits past the last slot would make forEach visit nonexistent objects
+    if (n%64 != 0 && (pool.activeBits.back() >> (n%64)) != 0)
+        throw std::runtime_error(std::string("SmartMap::load: corrupt slots of type ") +
+            std::string(TypeNameTraits<T>::name));
+    if constexpr (ObjectPool<T>::stableAddresses) {
+        for (Id<T> i=0; i<n; i+=chunkSize)
+            readRaw(in, &pool.generations[i], std::min<std::size_t>(chunkSize, n-i)*sizeof(std::uint32_t));
+    }
+    else
+        readRaw(in, pool.generations.data(), n*sizeof(std::uint32_t));
 
+    // Inactive slots are pushed in reverse so that the lowest IDs get reused first
+    for (Id<T> i=n; i>0; --i)
+        if (!pool.isActive(i-1))
+            pool.inactiveIds.push_back(i-1);
     pool.invalidated = false;
+
+    auto nIdMaps = readU64(in);
+    for (std::uint64_t i=0; i<nIdMaps; ++i) {
+        auto keyTypeId = readU64(in);
+        auto loader = idMapLoaders().find({ getStableTypeId<T>(), keyTypeId });
+        if (loader == idMapLoaders().end())
+            throw std::runtime_error("SmartMap::load: unknown key type " + std::to_string(keyTypeId) +
+                " for object type " + std::string(TypeNameTraits<T>::name));
+        if (loader->second == nullptr)
+            throw std::runtime_error("SmartMap::load: several key types have StableTypeId " +
+                std::to_string(keyTypeId) + ", see SmartMap::TypeNameTraits");
+        loader->second(map, in);
+    }
 }
 
-template <typename T>
-void SmartMap::updatePointerMapData(const SmartMap* oldMap, SmartMap* newMap)
+template <typename T, typename K>
+void SmartMap::writeIdMap(const void* idMap, std::ostream& out)
+{
+    using Traits = SerializationTraits<K>;
+    auto& m = *static_cast<const IdMap<T, K>*>(idMap);
+    std::uint64_t n = m.size();
+
+    // Entries are sorted by the key hash, which allows MappedSmartMap to look
+    // them up with binary search
+    std::vector<std::pair<std::uint64_t, const typename IdMap<T, K>::value_type*>> entries;
+    entries.reserve(n);
+    typename KeyTraits<K>::Hash hash;
+    for (auto& entry : m)
+        entries.emplace_back(hash(entry.first), &entry);
+    std::sort(entries.begin(), entries.end(), [](const auto& e1, const auto& e2) {
+        return e1.first < e2.first;
+    });
+
+    writeU64(out, getStableTypeId<K>());
+    writeU64(out, sizeof(K));
+    writeU64(out, n);
+    writeU64(out, Traits::raw);
+
+    writePadding(out, sizeof(std::uint64_t));
+    for (auto& e : entries)
+        writeU64(out, e.first);
+    for (auto& e : entries)
+        writeU64(out, e.second->second);
+
+    // Raw keys are stored as an aligned array, serialized ones are preceded by
+    // their offsets so that they can be located without parsing
+    if constexpr (Traits::raw) {
+        writePadding(out, fileArrayAlignment);
+        for (auto& e : entries)
+            writeRaw(out, &e.second->first, sizeof(K));
+    }
+    else {
+        std::ostringstream keys;
+        for (auto& e : entries) {
+            writeU64(out, (std::uint64_t)keys.tellp());
+            Traits::write(keys, e.second->first);
+        }
+        auto data = keys.str();
+        writeU64(out, data.size());
+        writeRaw(out, data.data(), data.size());
+    }
+}
+
+template <typename T, typename K>
+void SmartMap::loadIdMap(SmartMap& map, std::istream& in)
 {
-    // Update the _map pointers of the Pointers
-    for (auto& p : pointerPoolMap<T>[oldMap].data)
-        if (p.active)
-            p.o->_map = newMap;
+    using Traits = SerializationTraits<K>;
+
+    auto keySize = readU64(in);
+    auto n = readU64(in);
+    auto raw = readU64(in);
+    if (keySize != sizeof(K) || raw != Traits::raw)
+        throw std::runtime_error(std::string("SmartMap::load: stored layout of key type ") +
+            std::string(TypeNameTraits<K>::name) + " differs");
+
+    // Each key takes at least its hash and id
+    checkAvailable(in, n, 2*sizeof(std::uint64_t));
+    skipPadding(in, sizeof(std::uint64_t));
+    skipRaw(in, n*sizeof(std::uint64_t)); // hashes
+    std::vector<std::uint64_t> ids(n);
+    readRaw(in, ids.data(), n*sizeof(std::uint64_t));
+
+    // Keys may only refer to the active objects loaded before them, otherwise
+    // lookups would access slots that don't exist
+    auto& s = map.storage<T>();
+    for (auto id : ids)
+        if (id >= s.pool.size() || !s.pool.isActive(id))
+            throw std::runtime_error(std::string("SmartMap::load: key of type ") +
+                std::string(TypeNameTraits<K>::name) + " refers to a nonexistent object of type " +
+                std::string(TypeNameTraits<T>::name));
+
+    if constexpr (Traits::raw)
+        skipPadding(in, fileArrayAlignment);
+    else
+        skipRaw(in, (n+1)*sizeof(std::uint64_t)); // offsets
+
+    auto& idMap = s.template accessIdMap<K>();
+    idMap.reserve(n);
+    for (std::uint64_t i=0; i<n; ++i) {
+        K key;
+        Traits::read(in, key);
+        checkStream(in);
+        idMap.try_emplace(std::move(key), ids[i]);
+    }
 }
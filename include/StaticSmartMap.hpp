@@ -0,0 +1,148 @@
+//
+// Project: SmartMap
+// File: StaticSmartMap.hpp
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef SMARTMAP_STATICSMARTMAP_HPP
+#define SMARTMAP_STATICSMARTMAP_HPP
+
+
+#include "SmartMap.hpp"
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+
+// Variant of SmartMap for a set of object types known at compile time. The
+// storages of the types are found from a tuple instead of a type-indexed
+// table, and copying, moving and destroying the map is done without calling
+// through function pointers. Key types are not limited.
+//
+// The interface and the Pointers are the ones of SmartMap, except that there
+// are no copy-on-write snapshots.
+template <typename... Types>
+class StaticSmartMap {
+    template <typename T>
+    static constexpr bool stores = (std::is_same_v<T, Types> || ...);
+
+    template <typename T>
+    using Id = SmartMap::Id<T>;
+
+    template <typename T>
+    using TypeStorage = SmartMap::TypeStorage<T>;
+
+public:
+    static_assert(sizeof...(Types) > 0, "StaticSmartMap requires at least one type");
+
+    template <typename T>
+    using Pointer = SmartMap::Pointer<T>;
+
+    StaticSmartMap();
+    /// Construct a map allocating all of its internal data from resource, see
+    /// SmartMap(std::pmr::memory_resource*)
+    explicit StaticSmartMap(std::pmr::memory_resource* resource);
+
+    /// Copy constructor, the copy uses the default memory resource
+    StaticSmartMap(const StaticSmartMap& other);
+    /// Copy to a map using memory resource resource
+    StaticSmartMap(const StaticSmartMap& other, std::pmr::memory_resource* resource);
+    /// Move constructor and assignment transfer the data of the other map as
+    /// is, see SmartMap(SmartMap&&). The moved-to map uses the memory resource
+    /// of the other map.
+    StaticSmartMap(StaticSmartMap&& other) noexcept;
+    StaticSmartMap& operator=(const StaticSmartMap& other);
+    StaticSmartMap& operator=(StaticSmartMap&& other) noexcept;
+
+    ~StaticSmartMap();
+
+    /// Get a pointer to object of specific type
+    /// T: Data type, one of Types
+    /// K: Key type
+    template <typename T, typename K>
+    Pointer<T> getPointer(const K& key);
+
+    /// Overload for string literal -> std::string mapping
+    template <typename T>
+    Pointer<T> getPointer(const char* key);
+
+    /// Overload for std::string_view -> std::string mapping
+    template <typename T>
+    Pointer<T> getPointer(std::string_view key);
+
+    /// Find object of type T with key of type K without modifying the map,
+    /// returns nullptr in case the key doesn't exist
+    template <typename T, typename K>
+    const T* find(const K& key) const;
+
+    /// Overload for string literal -> std::string mapping
+    template <typename T>
+    const T* find(const char* key) const;
+
+    /// Overload for std::string_view -> std::string mapping
+    template <typename T>
+    const T* find(std::string_view key) const;
+
+    /// Erase object of type T with key of type K, returns true in case the key
+    /// existed. Pointers to the object are invalidated.
+    template <typename T, typename K>
+    bool erase(const K& key);
+
+    /// Overload for string literal -> std::string mapping
+    template <typename T>
+    bool erase(const char* key);
+
+    /// Overload for std::string_view -> std::string mapping
+    template <typename T>
+    bool erase(std::string_view key);
+
+    /// Call f(T&) for each object of type T. Objects are visited in storage
+    /// order, f must not insert or erase objects of type T.
+    template <typename T, typename F>
+    void forEach(F&& f);
+
+    /// Allocate space for n objects of type T
+    template <typename T>
+    void reserve(std::size_t n);
+
+    /// Memory resource used for allocating the internal data
+    std::pmr::memory_resource* getMemoryResource() const noexcept;
+
+private:
+    std::pmr::memory_resource*          _resource;
+    // Storages of the types, created on first use. Storages are allocated
+    // separately so that they stay in place when the map is moved.
+    std::tuple<TypeStorage<Types>*...>  _storages;
+
+    // Storage of objects of type T, nullptr in case it doesn't exist
+    template <typename T>
+    inline TypeStorage<T>* findStorage() const __attribute__((always_inline));
+
+    // Storage of objects of type T, creates it if it doesn't exist
+    template <typename T>
+    inline TypeStorage<T>& accessStorage() __attribute__((always_inline));
+
+    // Find ID of object of type T with key of type L from IdMap of key type K
+    template <typename T, typename K, typename L>
+    const Id<T>* findId(const L& key) const;
+
+    template <typename T, typename K, typename L>
+    bool eraseKey(const L& key);
+
+    // Invalidate the Pointers and delete the storages
+    void deleteData() noexcept;
+};
+
+
+#include "StaticSmartMap.inl"
+
+
+#endif //SMARTMAP_STATICSMARTMAP_HPP
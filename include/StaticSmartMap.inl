@@ -0,0 +1,274 @@
+//
+// Project: SmartMap
+// File: StaticSmartMap.inl
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <utility>
+
+
+template <typename... Types>
+StaticSmartMap<Types...>::StaticSmartMap() :
+    StaticSmartMap(std::pmr::get_default_resource())
+{
+}
+
+template <typename... Types>
+StaticSmartMap<Types...>::StaticSmartMap(std::pmr::memory_resource* resource) :
+    _resource   (resource),
+    _storages   (static_cast<TypeStorage<Types>*>(nullptr)...)
+{
+}
+
+template <typename... Types>
+StaticSmartMap<Types...>::StaticSmartMap(const StaticSmartMap& other) :
+    StaticSmartMap(other, std::pmr::get_default_resource())
+{
+}
+
+template <typename... Types>
+StaticSmartMap<Types...>::StaticSmartMap(const StaticSmartMap& other, std::pmr::memory_resource* resource) :
+    StaticSmartMap(resource)
+{
+    try {
+        ([&]() {
+            auto* o = other.template findStorage<Types>();
+            if (o != nullptr) {
+                std::get<TypeStorage<Types>*>(_storages) =
+                    std::pmr::polymorphic_allocator<>(_resource).new_object<TypeStorage<Types>>(*o);
+            }
+        }(), ...);
+    }
+    catch (...) {
+        // Destructor won't be called for partially constructed object
+        deleteData();
+        throw;
+    }
+}
+
+template <typename... Types>
+StaticSmartMap<Types...>::StaticSmartMap(StaticSmartMap&& other) noexcept :
+    _resource   (other._resource),
+    _storages   (other._storages)
+{
+    // The Pointers are bound to the storages, which stay in place
+    other._storages = std::tuple<TypeStorage<Types>*...>();
+}
+
+template <typename... Types>
+StaticSmartMap<Types...>& StaticSmartMap<Types...>::operator=(const StaticSmartMap& other)
+{
+    if (this == &other)
+        return *this;
+
+    // Copy first so that the map is left untouched in case copying throws
+    StaticSmartMap copy(other, getMemoryResource());
+    *this = std::move(copy);
+
+    return *this;
+}
+
+template <typename... Types>
+StaticSmartMap<Types...>& StaticSmartMap<Types...>::operator=(StaticSmartMap&& other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    // Storages carry their allocators, so they can be adopted regardless of the resource
+    deleteData();
+    _resource = other._resource;
+    _storages = other._storages;
+    other._storages = std::tuple<TypeStorage<Types>*...>();
+
+    return *this;
+}
+
+template <typename... Types>
+StaticSmartMap<Types...>::~StaticSmartMap()
+{
+    deleteData();
+}
+
+template <typename... Types>
+template <typename T, typename K>
+typename StaticSmartMap<Types...>::template Pointer<T> StaticSmartMap<Types...>::getPointer(const K& key)
+{
+    auto& s = accessStorage<T>();
+    return Pointer<T>(s, SmartMap::insertObject(s, key));
+}
+
+template <typename... Types>
+template <typename T>
+typename StaticSmartMap<Types...>::template Pointer<T> StaticSmartMap<Types...>::getPointer(const char* key)
+{
+    return getPointer<T>(std::string_view(key));
+}
+
+template <typename... Types>
+template <typename T>
+typename StaticSmartMap<Types...>::template Pointer<T> StaticSmartMap<Types...>::getPointer(std::string_view key)
+{
+    // Look up with the std::string_view first, std::string is only required
+    // when a new key gets inserted
+    auto* id = findId<T, std::string>(key);
+    if (id != nullptr)
+        return Pointer<T>(*findStorage<T>(), *id);
+
+    return getPointer<T, std::string>(std::string(key));
+}
+
+template <typename... Types>
+template <typename T, typename K>
+const T* StaticSmartMap<Types...>::find(const K& key) const
+{
+    auto* id = findId<T, K>(key);
+    if (id == nullptr)
+        return nullptr;
+
+    return &findStorage<T>()->pool.objects[*id];
+}
+
+template <typename... Types>
+template <typename T>
+const T* StaticSmartMap<Types...>::find(const char* key) const
+{
+    return find<T>(std::string_view(key));
+}
+
+template <typename... Types>
+template <typename T>
+const T* StaticSmartMap<Types...>::find(std::string_view key) const
+{
+    auto* id = findId<T, std::string>(key);
+    if (id == nullptr)
+        return nullptr;
+
+    return &findStorage<T>()->pool.objects[*id];
+}
+
+template <typename... Types>
+template <typename T, typename K>
+bool StaticSmartMap<Types...>::erase(const K& key)
+{
+    return eraseKey<T, K>(key);
+}
+
+template <typename... Types>
+template <typename T>
+bool StaticSmartMap<Types...>::erase(const char* key)
+{
+    return eraseKey<T, std::string>(std::string_view(key));
+}
+
+template <typename... Types>
+template <typename T>
+bool StaticSmartMap<Types...>::erase(std::string_view key)
+{
+    return eraseKey<T, std::string>(key);
+}
+
+template <typename... Types>
+template <typename T, typename F>
+void StaticSmartMap<Types...>::forEach(F&& f)
+{
+    auto* s = findStorage<T>();
+    if (s == nullptr)
+        return;
+
+    auto& pool = s->pool;
+    pool.forEachActive(0, pool.size(), [&](Id<T> id) { f(pool[id]); });
+}
+
+template <typename... Types>
+template <typename T>
+void StaticSmartMap<Types...>::reserve(std::size_t n)
+{
+    auto& s = accessStorage<T>();
+    s.pool.reserve(n);
+    if (!SmartMap::ObjectPool<T>::stableAddresses && s.pool.invalidated)
+        SmartMap::updatePointerObjectData(s);
+}
+
+template <typename... Types>
+std::pmr::memory_resource* StaticSmartMap<Types...>::getMemoryResource() const noexcept
+{
+    return _resource;
+}
+
+template <typename... Types>
+template <typename T>
+typename StaticSmartMap<Types...>::template TypeStorage<T>* StaticSmartMap<Types...>::findStorage() const
+{
+    static_assert(stores<T>, "T is not one of the types of the StaticSmartMap");
+    return std::get<TypeStorage<T>*>(_storages);
+}
+
+template <typename... Types>
+template <typename T>
+typename StaticSmartMap<Types...>::template TypeStorage<T>& StaticSmartMap<Types...>::accessStorage()
+{
+    static_assert(stores<T>, "T is not one of the types of the StaticSmartMap");
+
+    auto& s = std::get<TypeStorage<T>*>(_storages);
+    if (s == nullptr)
+        s = std::pmr::polymorphic_allocator<>(_resource).new_object<TypeStorage<T>>();
+
+    return *s;
+}
+
+template <typename... Types>
+template <typename T, typename K, typename L>
+const typename StaticSmartMap<Types...>::template Id<T>* StaticSmartMap<Types...>::findId(const L& key) const
+{
+    static const auto keyTypeId = SmartMap::getTypeId<K>(); // key type id
+
+    const auto* s = findStorage<T>();
+    if (s == nullptr || s->idMaps.size() <= keyTypeId || s->idMaps[keyTypeId].idMap == nullptr)
+        return nullptr;
+
+    const auto* idMap = static_cast<const SmartMap::IdMap<T, K>*>(s->idMaps[keyTypeId].idMap);
+    auto it = idMap->find(key);
+    if (it == idMap->end())
+        return nullptr;
+
+    return &it->second;
+}
+
+template <typename... Types>
+template <typename T, typename K, typename L>
+bool StaticSmartMap<Types...>::eraseKey(const L& key)
+{
+    static const auto keyTypeId = SmartMap::getTypeId<K>(); // key type id
+
+    auto* s = findStorage<T>();
+    if (s == nullptr || s->idMaps.size() <= keyTypeId || s->idMaps[keyTypeId].idMap == nullptr)
+        return false;
+
+    auto* idMap = static_cast<SmartMap::IdMap<T, K>*>(s->idMaps[keyTypeId].idMap);
+    auto it = idMap->find(key);
+    if (it == idMap->end())
+        return false;
+
+    auto id = it->second;
+    idMap->erase(it);
+    SmartMap::releaseObject(*s, id);
+
+    return true;
+}
+
+template <typename... Types>
+void StaticSmartMap<Types...>::deleteData() noexcept
+{
+    ([&]() {
+        auto*& s = std::get<TypeStorage<Types>*>(_storages);
+        if (s != nullptr) {
+            SmartMap::invalidatePointers<Types>(s);
+            SmartMap::deleteStorage<Types>(s);
+            s = nullptr;
+        }
+    }(), ...);
+}
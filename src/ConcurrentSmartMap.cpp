@@ -0,0 +1,28 @@
+//
+// Project: SmartMap
+// File: ConcurrentSmartMap.cpp
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "ConcurrentSmartMap.hpp"
+
+
+ConcurrentSmartMap::ConcurrentSmartMap(std::size_t nShards) :
+    _shards     (new Shard[nShards > 0 ? nShards : 1]),
+    _nShards    (nShards > 0 ? nShards : 1)
+{
+}
+
+std::size_t ConcurrentSmartMap::nShards() const noexcept
+{
+    return _nShards;
+}
+
+ConcurrentSmartMap::Shard::Shard()
+{
+    map._pointerMutex = &pointerMutex;
+}
@@ -0,0 +1,206 @@
+//
+// Project: SmartMap
+// File: MappedSmartMap.cpp
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "MappedSmartMap.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+    // Bounds-checked sequential reading of the mapped file
+    class Reader {
+    public:
+        Reader(const char* data, std::size_t size) :
+            _data   (data),
+            _pos    (0),
+            _size   (size)
+        {}
+
+        const char* read(std::size_t size)
+        {
+            if (size > _size - _pos)
+                throw std::runtime_error("MappedSmartMap: unexpected end of file");
+            auto* p = _data + _pos;
+            _pos += size;
+            return p;
+        }
+
+        std::uint64_t readU64()
+        {
+            std::uint64_t value;
+            std::memcpy(&value, read(sizeof(value)), sizeof(value));
+            return value;
+        }
+
+        // Array of n elements of size elementSize, with the same overflow check
+        const char* readArray(std::uint64_t n, std::size_t elementSize)
+        {
+            if (n > (_size - _pos) / elementSize)
+                throw std::runtime_error("MappedSmartMap: unexpected end of file");
+            return read(n * elementSize);
+        }
+
+        void skipPadding(std::size_t alignment)
+        {
+            read((alignment - _pos%alignment) % alignment);
+        }
+
+        bool atEnd() const
+        {
+            return _pos == _size;
+        }
+
+    private:
+        const char* _data;
+        std::size_t _pos;
+        std::size_t _size;
+    };
+
+}
+
+
+MappedSmartMap::MappedSmartMap(const std::string& path) :
+    MappedSmartMap(open(path.c_str(), O_RDONLY), path)
+{
+}
+
+MappedSmartMap::MappedSmartMap(int fd, const std::string& name) :
+    _data   (nullptr),
+    _size   (0)
+{
+    if (fd < 0)
+        throw std::runtime_error("MappedSmartMap: unable to open " + name);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("MappedSmartMap: unable to map " + name);
+    }
+
+    _size = (std::size_t)st.st_size;
+    _data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping stays valid after closing
+    if (_data == MAP_FAILED) {
+        _data = nullptr;
+        throw std::runtime_error("MappedSmartMap: unable to map " + name);
+    }
+
+    try {
+        parse();
+    }
+    catch (...) {
+        munmap(_data, _size);
+        throw;
+    }
+}
+
+MappedSmartMap::MappedSmartMap(MappedSmartMap&& other) noexcept :
+    _data           (std::exchange(other._data, nullptr)),
+    _size           (std::exchange(other._size, 0)),
+    _typeSections   (std::move(other._typeSections))
+{
+}
+
+MappedSmartMap& MappedSmartMap::operator=(MappedSmartMap&& other) noexcept
+{
+    if (this != &other) {
+        if (_data != nullptr)
+            munmap(_data, _size);
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+        _typeSections = std::move(other._typeSections);
+    }
+    return *this;
+}
+
+MappedSmartMap::~MappedSmartMap()
+{
+    if (_data != nullptr)
+        munmap(_data, _size);
+}
+
+void MappedSmartMap::parse()
+{
+    // Layout of the file is documented in SmartMap::writeStorage and
+    // SmartMap::writeIdMap
+    Reader reader(static_cast<const char*>(_data), _size);
+
+    if (reader.readU64() != (((std::uint64_t)SmartMap::fileVersion << 32) | SmartMap::fileMagic))
+        throw std::runtime_error("MappedSmartMap: not a SmartMap file of version " +
+            std::to_string(SmartMap::fileVersion));
+
+    auto nTypes = reader.readU64();
+    for (std::uint64_t i=0; i<nTypes; ++i) {
+        TypeSection typeSection;
+        auto typeId = reader.readU64();
+        typeSection.objectSize = reader.readU64();
+        typeSection.n = reader.readU64();
+        typeSection.raw = reader.readU64() != 0;
+
+        if (typeSection.raw) {
+            if (typeSection.objectSize == 0)
+                throw std::runtime_error("MappedSmartMap: invalid object size of type " + std::to_string(typeId));
+            reader.skipPadding(SmartMap::fileArrayAlignment);
+            typeSection.objects = reader.readArray(typeSection.n, typeSection.objectSize);
+        }
+        else
+            reader.read(reader.readU64());
+
+        reader.skipPadding(sizeof(std::uint64_t));
+        typeSection.activeBits = reinterpret_cast<const std::uint64_t*>(
+            reader.readArray((typeSection.n+63)/64, sizeof(std::uint64_t)));
+        typeSection.generations = reinterpret_cast<const std::uint32_t*>(
+            reader.readArray(typeSection.n, sizeof(std::uint32_t)));
+
+        auto nIdMaps = reader.readU64();
+        for (std::uint64_t j=0; j<nIdMaps; ++j) {
+            KeySection keySection;
+            auto keyTypeId = reader.readU64();
+            keySection.keySize = reader.readU64();
+            keySection.n = reader.readU64();
+            keySection.raw = reader.readU64() != 0;
+
+            reader.skipPadding(sizeof(std::uint64_t));
+            keySection.hashes = reinterpret_cast<const std::uint64_t*>(
+                reader.readArray(keySection.n, sizeof(std::uint64_t)));
+            keySection.ids = reinterpret_cast<const std::uint64_t*>(
+                reader.readArray(keySection.n, sizeof(std::uint64_t)));
+
+            if (keySection.raw) {
+                if (keySection.keySize == 0)
+                    throw std::runtime_error("MappedSmartMap: invalid key size of type " + std::to_string(keyTypeId));
+                reader.skipPadding(SmartMap::fileArrayAlignment);
+                keySection.keys = reader.readArray(keySection.n, keySection.keySize);
+                keySection.keysSize = keySection.n * keySection.keySize;
+            }
+            else {
+                keySection.offsets = reinterpret_cast<const std::uint64_t*>(
+                    reader.readArray(keySection.n, sizeof(std::uint64_t)));
+                keySection.keysSize = reader.readU64();
+                keySection.keys = reader.read(keySection.keysSize);
+            }
+
+            typeSection.keySections.emplace(keyTypeId, keySection);
+        }
+
+        _typeSections.emplace(typeId, std::move(typeSection));
+    }
+
+    if (!reader.atEnd())
+        throw std::runtime_error("MappedSmartMap: trailing data in file");
+}
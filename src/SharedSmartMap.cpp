@@ -0,0 +1,274 @@
+//
+// Project: SmartMap
+// File: SharedSmartMap.cpp
+//
+// Copyright (c) 2020 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "SharedSmartMap.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+    // Stream buffer writing into a shared memory object through a mapping,
+    // which is grown as needed. The size of the object is set to the number of
+    // bytes written by finish.
+    class SharedMemoryBuffer : public std::streambuf {
+    public:
+        explicit SharedMemoryBuffer(int fd) :
+            _fd     (fd),
+            _data   (nullptr),
+            _size   (0)
+        {
+        }
+
+        ~SharedMemoryBuffer()
+        {
+            if (_data != nullptr)
+                munmap(_data, _size);
+        }
+
+        void finish()
+        {
+            auto written = (std::size_t)(pptr() - pbase());
+            if (ftruncate(_fd, (off_t)written) != 0)
+                throw std::runtime_error("SharedSmartMap: unable to resize shared memory");
+        }
+
+    protected:
+        int_type overflow(int_type c) override
+        {
+            auto written = (std::size_t)(pptr() - pbase());
+            auto size = std::max(_size*2, (std::size_t)1 << 20);
+            if (ftruncate(_fd, (off_t)size) != 0)
+                return traits_type::eof();
+
+            auto* data = static_cast<char*>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0));
+            if (data == MAP_FAILED)
+                return traits_type::eof();
+            if (_data != nullptr)
+                munmap(_data, _size);
+            _data = data;
+            _size = size;
+
+            setp(_data, _data + _size);
+            // pbump takes an int, advance in steps for large sizes
+            for (auto left = written; left > 0;) {
+                auto step = std::min(left, (std::size_t)std::numeric_limits<int>::max());
+                pbump((int)step);
+                left -= step;
+            }
+
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+                return sputc(traits_type::to_char_type(c));
+            return traits_type::not_eof(c);
+        }
+
+        // Only reporting the position is supported, which save uses for padding
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+        {
+            if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::out))
+                return pos_type(off_type(-1));
+            return pos_type(off_type(pptr() - pbase()));
+        }
+
+    private:
+        int         _fd;
+        char*       _data;
+        std::size_t _size;
+    };
+
+    // Open or create the control object of a map
+    int openControl(const std::string& name, bool create)
+    {
+        int fd = shm_open(name.c_str(), create ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+        if (fd < 0)
+            throw std::runtime_error("SharedSmartMap: unable to open " + name);
+        return fd;
+    }
+
+}
+
+
+SharedSmartMap::SharedSmartMap(const std::string& name) :
+    _name       (name),
+    _control    (nullptr),
+    _version    (0)
+{
+    int fd = openControl(controlName(name), false);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (std::size_t)st.st_size < sizeof(Control)) {
+        close(fd);
+        throw std::runtime_error("SharedSmartMap: " + name + " has not been published");
+    }
+
+    void* control = mmap(nullptr, sizeof(Control), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (control == MAP_FAILED)
+        throw std::runtime_error("SharedSmartMap: unable to map " + controlName(name));
+    _control = static_cast<const Control*>(control);
+
+    try {
+        if (!refresh())
+            throw std::runtime_error("SharedSmartMap: " + name + " has not been published");
+    }
+    catch (...) {
+        munmap(const_cast<Control*>(_control), sizeof(Control));
+        throw;
+    }
+}
+
+SharedSmartMap::SharedSmartMap(SharedSmartMap&& other) noexcept :
+    _name       (std::move(other._name)),
+    _control    (std::exchange(other._control, nullptr)),
+    _map        (std::move(other._map)),
+    _version    (std::exchange(other._version, 0))
+{
+}
+
+SharedSmartMap& SharedSmartMap::operator=(SharedSmartMap&& other) noexcept
+{
+    if (this != &other) {
+        if (_control != nullptr)
+            munmap(const_cast<Control*>(_control), sizeof(Control));
+        _name = std::move(other._name);
+        _control = std::exchange(other._control, nullptr);
+        _map = std::move(other._map);
+        _version = std::exchange(other._version, 0);
+    }
+    return *this;
+}
+
+SharedSmartMap::~SharedSmartMap()
+{
+    if (_control != nullptr)
+        munmap(const_cast<Control*>(_control), sizeof(Control));
+}
+
+std::uint64_t SharedSmartMap::publish(const SmartMap& map, const std::string& name)
+{
+    int controlFd = openControl(controlName(name), true);
+    struct stat st;
+    if (fstat(controlFd, &st) != 0 ||
+        ((std::size_t)st.st_size < sizeof(Control) && ftruncate(controlFd, sizeof(Control)) != 0)) {
+        close(controlFd);
+        throw std::runtime_error("SharedSmartMap: unable to create " + controlName(name));
+    }
+
+    // A new object is zero-filled, which is a valid Control with version 0
+    void* controlData = mmap(nullptr, sizeof(Control), PROT_READ | PROT_WRITE, MAP_SHARED, controlFd, 0);
+    close(controlFd);
+    if (controlData == MAP_FAILED)
+        throw std::runtime_error("SharedSmartMap: unable to map " + controlName(name));
+    auto* control = static_cast<Control*>(controlData);
+
+    auto version = control->version.load(std::memory_order_relaxed) + 1;
+    auto dataName = versionName(name, version);
+    try {
+        // Leftovers of an interrupted publish are replaced
+        shm_unlink(dataName.c_str());
+        int fd = shm_open(dataName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0)
+            throw std::runtime_error("SharedSmartMap: unable to create " + dataName);
+
+        try {
+            SharedMemoryBuffer buffer(fd);
+            std::ostream out(&buffer);
+            map.save(out);
+            buffer.finish();
+        }
+        catch (...) {
+            close(fd);
+            shm_unlink(dataName.c_str());
+            throw;
+        }
+        close(fd);
+    }
+    catch (...) {
+        munmap(controlData, sizeof(Control));
+        throw;
+    }
+
+    // Readers see the new version only once it has been written completely.
+    // Mappings of the previous version stay valid after unlinking it.
+    control->version.store(version, std::memory_order_release);
+    munmap(controlData, sizeof(Control));
+    if (version > 1)
+        shm_unlink(versionName(name, version-1).c_str());
+
+    return version;
+}
+
+void SharedSmartMap::unlink(const std::string& name)
+{
+    int fd = shm_open(controlName(name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return;
+
+    void* control = mmap(nullptr, sizeof(Control), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (control != MAP_FAILED) {
+        auto version = static_cast<const Control*>(control)->version.load(std::memory_order_acquire);
+        munmap(control, sizeof(Control));
+        if (version > 0)
+            shm_unlink(versionName(name, version).c_str());
+    }
+    shm_unlink(controlName(name).c_str());
+}
+
+bool SharedSmartMap::refresh()
+{
+    std::uint64_t missingVersion = 0;
+    for (;;) {
+        auto version = _control->version.load(std::memory_order_acquire);
+        if (version == 0 || version == _version)
+            return false;
+
+        // The writer unlinks the previous version after publishing a new one,
+        // in which case the latest version is tried again. The latest version
+        // can only be missing in case the map has been unlinked.
+        int fd = shm_open(versionName(_name, version).c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            if (errno == ENOENT && version != missingVersion) {
+                missingVersion = version;
+                continue;
+            }
+            throw std::runtime_error("SharedSmartMap: unable to open " + versionName(_name, version));
+        }
+
+        _map = std::unique_ptr<MappedSmartMap>(new MappedSmartMap(fd, versionName(_name, version)));
+        _version = version;
+        return true;
+    }
+}
+
+std::uint64_t SharedSmartMap::version() const noexcept
+{
+    return _version;
+}
+
+std::string SharedSmartMap::controlName(const std::string& name)
+{
+    return "/" + name;
+}
+
+std::string SharedSmartMap::versionName(const std::string& name, std::uint64_t version)
+{
+    return "/" + name + "." + std::to_string(version);
+}
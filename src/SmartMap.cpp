@@ -9,89 +9,355 @@
 //
 
 #include "SmartMap.hpp"
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
 
 
-// Initializations for SmartMap static member variables
-SmartMap::TypeId SmartMap::typeIdCounter = 0;
+// Member functions of SmartMap
+SmartMap::SmartMap() noexcept :
+    SmartMap(std::pmr::get_default_resource())
+{
+}
 
+SmartMap::SmartMap(std::pmr::memory_resource* resource) noexcept :
+    _typeHelpers    (resource)
+{
+}
 
-// Member functions of SmartMap
 SmartMap::SmartMap(const SmartMap& other) :
-    _typeHelpers    (other._typeHelpers)
+    SmartMap(other, std::pmr::get_default_resource())
 {
-    copyData(&other, this);
+}
+
+SmartMap::SmartMap(const SmartMap& other, std::pmr::memory_resource* resource) :
+    _typeHelpers    (resource)
+{
+    copyData(other);
 }
 
 SmartMap::SmartMap(SmartMap&& other) noexcept :
-    _typeHelpers    (std::move(other._typeHelpers))
+    _typeHelpers    (other._typeHelpers.get_allocator())
 {
-    moveData(&other, this);
+    moveData(other);
 }
 
 SmartMap& SmartMap::operator=(const SmartMap& other)
 {
+    if (this == &other)
+        return *this;
+
     // Delete the previous data
-    moveData(this);
-    _typeHelpers = other._typeHelpers;
-    copyData(&other, this);
+    deleteData();
+    copyData(other);
 
     return *this;
 }
 
-SmartMap& SmartMap::operator=(SmartMap&& other) noexcept
+SmartMap& SmartMap::operator=(SmartMap&& other)
 {
-    // Delete the previous data
-    moveData(this);
-    _typeHelpers = std::move(other._typeHelpers);
-    moveData(&other, this);
+    if (this == &other)
+        return *this;
+
+    if (_typeHelpers.get_allocator() == other._typeHelpers.get_allocator()) {
+        deleteData();
+        moveData(other);
+    }
+    else {
+        // The TypeHelpers have to be copied to the memory resource of this
+        // map, copy first so that the map is left untouched in case copying
+        // throws. The storages are still taken over as is.
+        std::pmr::vector<TypeHelper> typeHelpers(other._typeHelpers, _typeHelpers.get_allocator());
+        deleteData();
+        _typeHelpers.swap(typeHelpers);
+        other._typeHelpers.clear();
+    }
 
     return *this;
 }
 
 SmartMap::~SmartMap()
 {
-    moveData(this);
+    deleteData();
+}
+
+SmartMap SmartMap::snapshot() const
+{
+    SmartMap map(getMemoryResource());
+    map.copyData(*this, true);
+    return map;
+}
+
+std::pmr::memory_resource* SmartMap::getMemoryResource() const noexcept
+{
+    return _typeHelpers.get_allocator().resource();
+}
+
+SmartMap::IdMapHelper::IdMapHelper() noexcept :
+    idMap               (nullptr),
+    idMapCopier         (nullptr),
+    idMapDeleter        (nullptr),
+    idMapWriter         (nullptr),
+    idMapStatsGetter    (nullptr)
+{
 }
 
 SmartMap::TypeHelper::TypeHelper() noexcept :
-    pointerMapDataUpdater   (nullptr),
-    poolMover               (nullptr),
-    pointerPoolMover        (nullptr)
+    storage                 (nullptr),
+    pointerInvalidator      (nullptr),
+    storageCopier           (nullptr),
+    storageDeleter          (nullptr),
+    storageWriter           (nullptr),
+    storageStatsGetter      (nullptr)
 {
 }
 
-void SmartMap::moveData(const SmartMap* oldMap, SmartMap* newMap)
+std::vector<SmartMap::TypeStats> SmartMap::stats() const
 {
-    for (auto& m : _typeHelpers) {
-        if (m.pointerMapDataUpdater == nullptr)
+    std::vector<TypeStats> stats;
+    for (TypeId i=0; i<(TypeId)_typeHelpers.size(); ++i) {
+        auto& m = _typeHelpers[i];
+        if (m.storage == nullptr)
             continue;
 
-        m.pointerMapDataUpdater(oldMap, newMap);
-        m.poolMover(oldMap, newMap);
-        m.pointerPoolMover(oldMap, newMap);
+        auto& s = stats.emplace_back();
+        s.typeId = i;
+        m.storageStatsGetter(m.storage, s);
+    }
+
+    return stats;
+}
+
+void SmartMap::moveData(SmartMap& other) noexcept
+{
+    // Pointers are bound to the storages, which stay in place, so moving is
+    // independent of the number of Pointers
+    _typeHelpers.swap(other._typeHelpers);
+    other._typeHelpers.clear();
+}
+
+void SmartMap::copyData(const SmartMap& other, bool share)
+{
+    _typeHelpers = other._typeHelpers;
+    for (auto& m : _typeHelpers)
+        m.storage = nullptr;
 
-        for (auto& idMapMover : m.idMapMovers) {
-            if (idMapMover != nullptr)
-                idMapMover(oldMap, newMap);
+    try {
+        for (std::size_t i=0; i<_typeHelpers.size(); ++i) {
+            auto& m = other._typeHelpers[i];
+            if (m.storage != nullptr)
+                _typeHelpers[i].storage = m.storageCopier(m.storage, getMemoryResource(), share);
         }
     }
+    catch (...) {
+        deleteData();
+        throw;
+    }
 }
 
-void SmartMap::copyData(const SmartMap* oldMap, const SmartMap* newMap)
+void SmartMap::deleteData() noexcept
 {
-    if (newMap == nullptr)
-        return;
+    for (auto& m : _typeHelpers) {
+        if (m.storage == nullptr)
+            continue;
+
+        m.pointerInvalidator(m.storage);
+        m.storageDeleter(m.storage);
+    }
+
+    _typeHelpers.clear();
+}
+
+void SmartMap::save(const std::string& path) const
+{
+    // Check that all the types can be written before overwriting the file
+    countSerializableTypes();
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("SmartMap::save: unable to open " + path);
+
+    try {
+        save(out);
+        out.flush();
+        if (!out)
+            throw std::runtime_error("SmartMap::save: writing " + path + " failed");
+    }
+    catch (...) {
+        // Don't leave partially written files behind
+        out.close();
+        std::remove(path.c_str());
+        throw;
+    }
+}
+
+void SmartMap::save(std::ostream& out) const
+{
+    auto nTypes = countSerializableTypes();
+
+    writeU64(out, ((std::uint64_t)fileVersion << 32) | fileMagic);
+    writeU64(out, nTypes);
+    for (auto& m : _typeHelpers)
+        if (m.storage != nullptr)
+            m.storageWriter(m.storage, out);
+}
+
+SmartMap SmartMap::load(const std::string& path, std::pmr::memory_resource* resource)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("SmartMap::load: unable to open " + path);
+
+    return load(in, resource);
+}
+
+SmartMap SmartMap::load(std::istream& in, std::pmr::memory_resource* resource)
+{
+    if (readU64(in) != (((std::uint64_t)fileVersion << 32) | fileMagic))
+        throw std::runtime_error("SmartMap::load: data is not a SmartMap file of version " +
+            std::to_string(fileVersion));
+
+    SmartMap map(resource);
+    auto nTypes = readU64(in);
+    for (std::uint64_t i=0; i<nTypes; ++i) {
+        auto typeId = readU64(in);
+        auto loader = storageLoaders().find(typeId);
+        if (loader == storageLoaders().end())
+            throw std::runtime_error("SmartMap::load: unknown object type " + std::to_string(typeId));
+        if (loader->second == nullptr)
+            throw std::runtime_error("SmartMap::load: several object types have StableTypeId " +
+                std::to_string(typeId) + ", see SmartMap::TypeNameTraits");
+        loader->second(map, in);
+    }
+
+    return map;
+}
 
+std::uint64_t SmartMap::countSerializableTypes() const
+{
+    std::uint64_t nTypes = 0;
     for (auto& m : _typeHelpers) {
-        if (m.pointerMapDataUpdater == nullptr)
+        if (m.storage == nullptr)
             continue;
+        if (m.storageWriter == nullptr)
+            throw std::runtime_error("SmartMap::save: map contains a type that is not serializable");
+        ++nTypes;
+    }
+    return nTypes;
+}
 
-        m.poolCopier(oldMap, newMap);
-        m.pointerPoolCopier(oldMap, newMap);
+SmartMap::TypeId SmartMap::registerType(StableTypeId stableTypeId, std::string_view name)
+{
+    static std::mutex mutex;
+    static std::unordered_map<StableTypeId, std::string_view> names;
+    static TypeId typeIdCounter = 0;
 
-        for (auto& idMapCopier : m.idMapCopiers) {
-            if (idMapCopier != nullptr)
-                idMapCopier(oldMap, newMap);
-        }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto [it, inserted] = names.try_emplace(stableTypeId, name);
+    if (!inserted)
+        throw std::logic_error("SmartMap: types " + std::string(it->second) + " and " +
+            std::string(name) + " have the same StableTypeId, see SmartMap::TypeNameTraits");
+
+    return typeIdCounter++;
+}
+
+std::unordered_map<SmartMap::StableTypeId, SmartMap::Loader>& SmartMap::storageLoaders()
+{
+    static std::unordered_map<StableTypeId, Loader> loaders;
+    return loaders;
+}
+
+std::map<std::pair<SmartMap::StableTypeId, SmartMap::StableTypeId>, SmartMap::Loader>& SmartMap::idMapLoaders()
+{
+    static std::map<std::pair<StableTypeId, StableTypeId>, Loader> loaders;
+    return loaders;
+}
+
+void SmartMap::writeRaw(std::ostream& out, const void* data, std::size_t size)
+{
+    if (!out.write(static_cast<const char*>(data), (std::streamsize)size))
+        throw std::runtime_error("SmartMap::save: write failed");
+}
+
+void SmartMap::writeU64(std::ostream& out, std::uint64_t value)
+{
+    writeRaw(out, &value, sizeof(value));
+}
+
+void SmartMap::writeString(std::ostream& out, std::string_view str)
+{
+    writeU64(out, str.size());
+    writeRaw(out, str.data(), str.size());
+}
+
+void SmartMap::writePadding(std::ostream& out, std::size_t alignment)
+{
+    static const char zeros[fileArrayAlignment] = {};
+    auto pos = (std::size_t)out.tellp();
+    writeRaw(out, zeros, (alignment - pos%alignment) % alignment);
+}
+
+void SmartMap::readRaw(std::istream& in, void* data, std::size_t size)
+{
+    if (!in.read(static_cast<char*>(data), (std::streamsize)size))
+        throw std::runtime_error("SmartMap::load: unexpected end of file");
+}
+
+std::uint64_t SmartMap::readU64(std::istream& in)
+{
+    std::uint64_t value;
+    readRaw(in, &value, sizeof(value));
+    return value;
+}
+
+std::string SmartMap::readString(std::istream& in)
+{
+    auto size = readU64(in);
+    checkAvailable(in, size, 1);
+    std::string str(size, '\0');
+    readRaw(in, str.data(), str.size());
+    return str;
+}
+
+void SmartMap::skipRaw(std::istream& in, std::size_t size)
+{
+    if (in.ignore((std::streamsize)size).gcount() != (std::streamsize)size)
+        throw std::runtime_error("SmartMap::load: unexpected end of file");
+}
+
+void SmartMap::skipPadding(std::istream& in, std::size_t alignment)
+{
+    auto pos = (std::size_t)in.tellg();
+    skipRaw(in, (alignment - pos%alignment) % alignment);
+}
+
+void SmartMap::checkAvailable(std::istream& in, std::uint64_t n, std::size_t size)
+{
+    // Streams that can't seek are only checked while reading
+    auto pos = in.tellg();
+    if (pos < 0 || !in.seekg(0, std::ios::end)) {
+        in.clear();
+        return;
     }
+    auto end = in.tellg();
+    in.seekg(pos);
+    if (end < pos || n > (std::uint64_t)(end-pos) / size)
+        throw std::runtime_error("SmartMap::load: unexpected end of file");
+}
+
+void SmartMap::checkStream(std::istream& in)
+{
+    if (!in)
+        throw std::runtime_error("SmartMap::load: unexpected end of file");
 }
+
+void SmartMap::SerializationTraits<std::string>::write(std::ostream& out, const std::string& o)
+{
+    writeString(out, o);
+}
+
+void SmartMap::SerializationTraits<std::string>::read(std::istream& in, std::string& o)
+{
+    o = readString(in);
+}
+
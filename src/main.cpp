@@ -9,10 +9,132 @@
 //
 
 #include "SmartMap.hpp"
+#include "ConcurrentSmartMap.hpp"
+#include "MappedSmartMap.hpp"
+#include "SharedSmartMap.hpp"
+#include "StaticSmartMap.hpp"
 #include <iostream>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <unordered_map>
 #include <cassert>
+#include <memory_resource>
+#include <vector>
+#include <filesystem>
+#include <stdexcept>
+#include <sstream>
 
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+// Type stored in fixed-size chunks instead of a contiguous vector
+struct ChunkedInt {
+    int value = 0;
+};
+
+template <>
+struct SmartMap::StorageTraits<ChunkedInt> {
+    static constexpr std::size_t chunkSize = 4;
+};
+
+// Object type using lazy Pointer rebinding
+struct LazyInt {
+    int value = 0;
+};
+
+template <>
+struct SmartMap::PointerTraits<LazyInt> {
+    static constexpr bool lazyRebinding = true;
+};
+
+// Type that can't be saved
+struct IntVector {
+    std::vector<int> values;
+};
+
+// Type registered with the name of another type
+struct NotInt {
+    int value;
+};
+
+template <>
+struct SmartMap::TypeNameTraits<NotInt> {
+    static constexpr std::string_view name = "int";
+};
+
+// Key type hashed through KeyTraits, without a std::hash specialization
+struct GridKey {
+    int x;
+    int y;
+
+    bool operator==(const GridKey&) const = default;
+};
+
+template <>
+struct SmartMap::KeyTraits<GridKey> {
+    struct Hash {
+        std::size_t operator()(const GridKey& key) const { return (std::size_t)key.x*31 + key.y; }
+    };
+    using Equal = std::equal_to<GridKey>;
+};
+
+
+int testFlatHashMap()
+{
+    // Compare against std::unordered_map with random insertions and erasures,
+    // small key range causes plenty of deleted slots to be reused
+    FlatHashMap<int, int> m1;
+    std::unordered_map<int, int> ref;
+    std::mt19937 rng(1337);
+    for (int i=0; i<100000; ++i) {
+        int key = rng() % 2000;
+        if (rng() % 3 == 0) {
+            [[maybe_unused]] auto erased = m1.erase(key);
+            assert(erased == ref.erase(key));
+        }
+        else {
+            [[maybe_unused]] auto [it, inserted] = m1.try_emplace(key, i);
+            [[maybe_unused]] bool refInserted = ref.try_emplace(key, i).second;
+            assert(inserted == refInserted);
+            assert(it->second == ref.at(key));
+        }
+    }
+    assert(m1.size() == ref.size());
+    for ([[maybe_unused]] auto& [key, value] : ref)
+        assert(m1.find(key)->second == value);
+
+    // Test iteration and copy
+    auto m2 = m1;
+    std::size_t n = 0;
+    for ([[maybe_unused]] auto& [key, value] : m2) {
+        assert(ref.at(key) == value);
+        ++n;
+    }
+    assert(n == ref.size());
+
+    // Test transparent lookup with std::string keys
+    FlatHashMap<std::string, int, SmartMap::KeyTraits<std::string>::Hash, std::equal_to<>> m3;
+    m3.try_emplace("a long key not fitting in small string buffer", 1);
+    assert(m3.find(std::string_view("a long key not fitting in small string buffer"))->second == 1);
+    assert(m3.find("not found") == m3.end());
+
+    // Test batched find against single lookups, including keys that don't exist
+    std::vector<int> keys(100);
+    for (int i=0; i<100; ++i)
+        keys[i] = i*37 % 2500;
+    std::vector<FlatHashMap<int, int>::const_iterator> its(keys.size());
+    std::as_const(m1).find(std::span<const int>(keys), its.data());
+    for (std::size_t i=0; i<keys.size(); ++i)
+        assert(its[i] == std::as_const(m1).find(keys[i]));
+    FlatHashMap<int, int> m4;
+    std::as_const(m4).find(std::span<const int>(keys), its.data());
+    assert(its[0] == m4.end() && its[99] == m4.end());
+
+    return 0;
+}
 
 int test()
 {
@@ -33,6 +155,10 @@ int test()
     assert(*ptr_1_1 == "kissa");
     assert(*ptr_1_2 == "kissa");
 
+    // Test pointer access with std::string_view
+    auto ptr_1_9 = c1.getPointer<std::string>(std::string_view("paavo"));
+    assert(*ptr_1_9 == "kissa");
+
     // Test access with another key
     auto ptr_1_3 = c1.getPointer<std::string>("mikko");
     *ptr_1_3 = "koira";
@@ -111,6 +237,12 @@ int test()
     *ptr_5_1 = "kissa";
     assert(*ptr_1_1 == "kissa");
 
+    // Test that data of all types gets moved
+    auto ptr_5_2 = c5.getPointer<int>("paavo");
+    assert(*ptr_5_2 == 10);
+    *ptr_5_2 = 11;
+    assert(*ptr_1_4 == 11);
+
     // Test SmartMap move assignment
     SmartMap c6;
     c6 = std::move(c2);
@@ -119,10 +251,581 @@ int test()
     *ptr_6_1 = "vuohi";
     assert(*ptr_2_1 == "vuohi");
 
+    // Test chunked storage: growing the pool must not move existing objects
+    SmartMap c7;
+    auto ptr_7_1 = c7.getPointer<ChunkedInt>(0);
+    (*ptr_7_1).value = 7;
+    [[maybe_unused]] ChunkedInt* addr_7_1 = &*ptr_7_1;
+    for (int i=1; i<100; ++i)
+        (*c7.getPointer<ChunkedInt>(i)).value = i;
+    assert(&*ptr_7_1 == addr_7_1);
+    assert((*ptr_7_1).value == 7);
+    assert((*c7.getPointer<ChunkedInt>(99)).value == 99);
+
+    // Test SmartMap copy and move with chunked storage
+    SmartMap c8 = c7;
+    auto ptr_8_1 = c8.getPointer<ChunkedInt>(0);
+    (*ptr_8_1).value = 8;
+    assert((*ptr_7_1).value == 7);
+    SmartMap c9 = std::move(c7);
+    assert(&*ptr_7_1 == addr_7_1);
+    assert((*c9.getPointer<ChunkedInt>(0)).value == 7);
+
+    // Test key erasure
+    SmartMap c11;
+    auto ptr_11_1 = c11.getPointer<std::string>("paavo");
+    auto ptr_11_2 = ptr_11_1;
+    *ptr_11_1 = "koira";
+    assert(ptr_11_1.isValid());
+    [[maybe_unused]] bool erased_11_1 = c11.erase<std::string>("paavo");
+    [[maybe_unused]] bool erased_11_2 = c11.erase<std::string>("paavo");
+    assert(erased_11_1 && !erased_11_2);
+    assert(!ptr_11_1.isValid());
+    assert(!ptr_11_2.isValid());
+
+    // Test that the slot gets reused and the object reset, old pointers stay invalid
+    auto ptr_11_3 = c11.getPointer<std::string>("mikko");
+    assert(&*ptr_11_3 == &*c11.getPointer<std::string>("mikko"));
+    assert(*ptr_11_3 == "");
+    assert(!ptr_11_1.isValid());
+    [[maybe_unused]] bool erased_11_3 = c11.erase<std::string, std::string>(std::string("mikko"));
+    assert(erased_11_3);
+    assert(!ptr_11_3.isValid());
+    assert(c11.getPointer<std::string>("paavo").isValid());
+
+    // Test that pointers assigned to an empty pointer get updated on pool growth
+    SmartMap::Pointer<int> ptr_11_4;
+    assert(!ptr_11_4.isValid());
+    ptr_11_4 = c11.getPointer<int>(0);
+    *ptr_11_4 = 1;
+    for (int i=1; i<100; ++i)
+        *c11.getPointer<int>(i) = i+1;
+    assert(*ptr_11_4 == 1);
+
+    // Test that a pointer to an erased object stays invalid after its slot has
+    // been reused and the pool has grown, and that copies of it are invalid too
+    auto ptr_11_5 = c11.getPointer<int>(5);
+    [[maybe_unused]] bool erased_11_4 = c11.erase<int>(5);
+    assert(erased_11_4);
+    auto ptr_11_6 = c11.getPointer<int>(1000);
+    for (int i=100; i<1000; ++i)
+        *c11.getPointer<int>(i) = i+1;
+    auto ptr_11_7 = ptr_11_5;
+    assert(!ptr_11_5.isValid());
+    assert(!ptr_11_7.isValid());
+    assert(ptr_11_6.isValid());
+    assert(*ptr_11_6 == 0);
+
+    // Test that views access the same object as the pointer
+    SmartMap::PointerView<int> view_11_1 = ptr_11_6;
+    *view_11_1 = 11;
+    [[maybe_unused]] auto view_11_2 = view_11_1;
+    assert(*ptr_11_6 == 11 && &*view_11_2 == &*ptr_11_6);
+#ifdef NDEBUG
+    assert(sizeof(view_11_1) == sizeof(int*));
+#endif
+
+    // Test that destroying the SmartMap invalidates its pointers
+    {
+        SmartMap c12;
+        ptr_11_4 = c12.getPointer<int>(0);
+        assert(ptr_11_4.isValid());
+    }
+    assert(!ptr_11_4.isValid());
+
+    // Test batch access: existing and duplicate keys map to the same objects,
+    // pointers obtained before the batch survive the pool growth
+    SmartMap c13;
+    auto ptr_13_1 = c13.getPointer<int>(1);
+    *ptr_13_1 = 13;
+    std::vector<int> keys_13 = { 0, 1, 2, 2 };
+    for (int i=3; i<100; ++i)
+        keys_13.push_back(i);
+    auto ptrs_13 = c13.getPointers<int, int>(keys_13);
+    assert(ptrs_13.size() == keys_13.size());
+    assert(*ptrs_13[1] == 13 && *ptr_13_1 == 13);
+    assert(&*ptrs_13[2] == &*ptrs_13[3]);
+    *ptrs_13[99] = 99;
+    assert(*c13.getPointer<int>(98) == 99);
+    c13.reserve<int, int>(1000);
+    assert(*ptr_13_1 == 13 && *ptrs_13[99] == 99);
+
+    // Test iteration, erased objects are skipped
+    [[maybe_unused]] bool erased_13 = c13.erase<int>(0);
+    assert(erased_13);
+    c13.forEach<int>([&](int& v) { v = 1; });
+    int sum_13 = 0;
+    c13.forEach<int>([&](int& v) { sum_13 += v; ++v; });
+    assert(sum_13 == 99);
+    int nKeys_13 = 0;
+    c13.forEachKey<int, int>([&]([[maybe_unused]] const int& key, [[maybe_unused]] int& v) {
+        assert(&v == &*c13.getPointer<int>(key));
+        ++nKeys_13;
+    });
+    assert(nKeys_13 == 99);
+    std::atomic<int> sum_13_2 = 0;
+    c13.parallelForEach<int>([&](int& v) { sum_13_2 += v; }, 4);
+    assert(sum_13_2 == 2*99);
+    c13.forEach<double>([&](double&) { assert(false); });
+
+    // Test iteration with erased objects around activity bitmap word boundaries
+    SmartMap c14;
+    for (int i=0; i<300; ++i)
+        *c14.getPointer<int>(i) = i;
+    for (int i : { 0, 63, 64, 65, 127, 128, 200, 299 }) {
+        [[maybe_unused]] bool erased_14 = c14.erase<int>(i);
+        assert(erased_14);
+    }
+    int sum_14 = 0;
+    c14.forEach<int>([&](int& v) { sum_14 += v; });
+    std::atomic<int> sum_14_2 = 0;
+    c14.parallelForEach<int>([&](int& v) { sum_14_2 += v; }, 3);
+    assert(sum_14 == 299*300/2 - (63+64+65+127+128+200+299));
+    assert(sum_14_2 == sum_14);
+
+    // Test that all internal data is allocated from the given memory resource,
+    // the default resource is replaced with one that fails on allocation
+    {
+        std::pmr::monotonic_buffer_resource arena;
+        auto* defaultResource = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+        SmartMap c15(&arena);
+        std::vector<SmartMap::Pointer<int>> ptrs_15;
+        for (int i=0; i<1000; ++i) {
+            ptrs_15.push_back(c15.getPointer<int>(i));
+            *ptrs_15.back() = i;
+        }
+        (*c15.getPointer<ChunkedInt>(std::string_view("a key longer than small string buffer"))).value = 15;
+        [[maybe_unused]] bool erased_15 = c15.erase<int>(5);
+        assert(erased_15);
+        SmartMap c16(c15, &arena);
+        SmartMap c17 = std::move(c16);
+        assert(c17.getMemoryResource() == &arena);
+        assert(*c17.getPointer<int>(999) == 999 && *ptrs_15[999] == 999);
+        assert((*c17.getPointer<ChunkedInt>("a key longer than small string buffer")).value == 15);
+
+        // Move assignment between different memory resources takes over the
+        // storages, or leaves both maps untouched in case allocation fails
+        std::pmr::monotonic_buffer_resource arena_17(defaultResource);
+        SmartMap c17_2(&arena_17);
+        *c17_2.getPointer<double>(0) = 17.0;
+        auto ptr_17 = c17.getPointer<int>(999);
+        c17_2 = std::move(c17);
+        assert(c17_2.getMemoryResource() == &arena_17 && c17.find<int>(999) == nullptr);
+        assert(*c17_2.find<int>(999) == 999 && c17_2.find<double>(0) == nullptr);
+        assert(c17_2.find<int>(999) == &*ptr_17);
+        SmartMap c17_3(std::pmr::null_memory_resource());
+        [[maybe_unused]] bool thrown_17 = false;
+        try {
+            c17_3 = std::move(c17_2);
+        }
+        catch (const std::bad_alloc&) {
+            thrown_17 = true;
+        }
+        assert(thrown_17 && *c17_2.find<int>(999) == 999 && c17_3.find<int>(999) == nullptr);
+        std::pmr::set_default_resource(defaultResource);
+    }
+
+    // Test copy-on-write snapshots: snapshots share the data of types without
+    // live pointers until either of the maps modifies it
+    SmartMap* c18 = new SmartMap;
+    for (int i=0; i<100; ++i)
+        *c18->getPointer<int>(i) = i;
+    *c18->getPointer<std::string>("paavo") = "koira";
+    auto ptr_18_1 = c18->getPointer<std::string>("paavo");
+    SmartMap c19 = c18->snapshot();
+    SmartMap c20 = c19.snapshot();
+    assert(c18->find<int>(1) == c19.find<int>(1) && c19.find<int>(1) == c20.find<int>(1));
+    assert(c18->find<std::string>("paavo") != c19.find<std::string>("paavo"));
+    assert(*c19.find<std::string>("paavo") == "koira");
+    assert(c19.find<int>(100) == nullptr && c19.find<double>(0) == nullptr);
+    *c19.getPointer<int>(1) = 19;
+    assert(*c18->find<int>(1) == 1 && *c19.find<int>(1) == 19 && *c20.find<int>(1) == 1);
+    assert(c18->find<int>(2) != c19.find<int>(2) && c18->find<int>(2) == c20.find<int>(2));
+    [[maybe_unused]] bool erased_18 = c18->erase<int>(2);
+    assert(erased_18);
+    assert(c18->find<int>(2) == nullptr && *c20.find<int>(2) == 2);
+    int sum_20 = 0;
+    c20.forEach<int>([&](int& v) { sum_20 += v; v = 0; });
+    assert(sum_20 == 99*100/2 && *c18->find<int>(3) == 3);
+    SmartMap c21 = c20;
+    delete c18;
+    assert(*c21.find<int>(3) == 0 && *c19.find<int>(3) == 3);
+
+    // Plain copies don't share data, so writes through references obtained
+    // before the copy don't show up in the copy
+    int* obj_21 = &*c21.getPointer<int>(4);
+    SmartMap c21_2 = c21;
+    assert(c21_2.find<int>(4) != obj_21);
+    *obj_21 = 21;
+    assert(*c21_2.find<int>(4) == 0 && *c21.find<int>(4) == 21);
+
+    // Test saving and loading, both into a SmartMap and memory mapped
+    {
+        auto path = (std::filesystem::temp_directory_path() / "smartmap_test.smap").string();
+        SmartMap c22;
+        for (int i=0; i<200; ++i) {
+            *c22.getPointer<int>(i) = i*i;
+            (*c22.getPointer<ChunkedInt>(i)).value = -i;
+            *c22.getPointer<int>("key " + std::to_string(i)) = i;
+        }
+        *c22.getPointer<std::string>(7) = "seitsemän";
+        [[maybe_unused]] bool erased_22 = c22.erase<int>(100) && c22.erase<int>("key 5");
+        assert(erased_22);
+        c22.save(path);
+
+        SmartMap c23 = SmartMap::load(path);
+        assert(c23.find<int>(100) == nullptr && c23.find<int>("key 5") == nullptr);
+        for (int i=0; i<200; ++i) {
+            if (i != 100)
+                assert(*c23.find<int>(i) == i*i);
+            assert(c23.find<ChunkedInt>(i)->value == -i);
+            if (i != 5)
+                assert(*c23.find<int>("key " + std::to_string(i)) == i);
+        }
+        assert(*c23.find<std::string>(7) == "seitsemän");
+        // Erased slots get reused after loading
+        *c23.getPointer<int>(1000) = 1000;
+        assert(*c23.find<int>(1000) == 1000 && *c23.find<int>(99) == 99*99);
+
+        // Truncated data throws, corrupted data either throws or loads objects
+        // that can be accessed through their keys (checked by the ASAN build)
+        std::stringstream stream_23;
+        SmartMap c26;
+        for (int i=0; i<10; ++i) {
+            *c26.getPointer<int>(i) = i;
+            (*c26.getPointer<ChunkedInt>("key " + std::to_string(i))).value = i;
+        }
+        *c26.getPointer<std::string>(7) = "seitsemän";
+        c26.erase<int>(3);
+        c26.save(stream_23);
+        auto data_23 = stream_23.str();
+        // Truncated data always throws. Flipping a byte of the object data
+        // can't be detected, but then at most one of the loaded objects differs
+        // from the saved ones and no ints appear in addition to the saved nine.
+        std::size_t nTruncated_23 = 0;
+        std::size_t nLoaded_23 = 0;
+        for (std::size_t i=0; i<data_23.size(); ++i) {
+            for (int j=0; j<2; ++j) {
+                // Truncate at i, or flip the bits of byte i
+                auto corrupt = j == 0 ? data_23.substr(0, i) : data_23;
+                if (j == 1)
+                    corrupt[i] = (char)~corrupt[i];
+                std::istringstream in(corrupt);
+                try {
+                    auto c = SmartMap::load(in);
+                    [[maybe_unused]] int nDiffering_23 = 0;
+                    for (int k=0; k<10; ++k) {
+                        auto* o = c.find<int>(k);
+                        auto* p = c.find<ChunkedInt>("key " + std::to_string(k));
+                        nDiffering_23 += (o != nullptr && *o != k) + (p != nullptr && p->value != k);
+                    }
+                    [[maybe_unused]] int nInts_23 = 0;
+                    c.forEach<int>([&](int&) { ++nInts_23; });
+                    assert(nDiffering_23 <= 1 && nInts_23 <= 9);
+                    ++nLoaded_23;
+                }
+                catch (const std::runtime_error&) {
+                    nTruncated_23 += j == 0;
+                }
+            }
+        }
+        assert(nTruncated_23 == data_23.size() && nLoaded_23 > 0);
+
+        MappedSmartMap c24(path);
+        assert(c24.find<int>(100) == nullptr && c24.find<int>("key 5") == nullptr);
+        assert(c24.find<double>(7) == nullptr && c24.find<int>(7.0) == nullptr);
+        for (int i=0; i<200; ++i) {
+            if (i != 100)
+                assert(*c24.find<int>(i) == i*i);
+            assert(c24.find<ChunkedInt>(i)->value == -i);
+            if (i != 5)
+                assert(*c24.find<int>("key " + std::to_string(i)) == i);
+        }
+        int sum_24 = 0;
+        c24.forEach<ChunkedInt>([&](const ChunkedInt& o) { sum_24 += o.value; });
+        assert(sum_24 == -199*200/2);
+
+        SmartMap c25;
+        c25.getPointer<IntVector>(0);
+        [[maybe_unused]] bool thrown_25 = false;
+        try {
+            c25.save(path);
+        }
+        catch (const std::runtime_error&) {
+            thrown_25 = true;
+        }
+        assert(thrown_25);
+        std::filesystem::remove(path);
+    }
+
+    // Test sharing maps through shared memory: readers keep their version until
+    // refresh, pointers follow the objects to new versions
+    {
+        std::string name = "smartmap_test_" + std::to_string(getpid());
+        SmartMap c27;
+        for (int i=0; i<100; ++i)
+            *c27.getPointer<int>(i) = i;
+        *c27.getPointer<int>("paavo") = 27;
+        [[maybe_unused]] auto version_27_1 = SharedSmartMap::publish(c27, name);
+        assert(version_27_1 == 1);
+
+        SharedSmartMap c28(name);
+        [[maybe_unused]] auto ptr_28_1 = c28.getPointer<int>(50);
+        [[maybe_unused]] auto ptr_28_2 = c28.getPointer<int>(60);
+        assert(c28.version() == 1 && *ptr_28_1 == 50 && *c28.find<int>("paavo") == 27);
+        assert(!c28.getPointer<int>(100).isValid() && c28.find<int>(100) == nullptr);
+
+        // Another process sees the published map
+        pid_t pid = fork();
+        if (pid == 0) {
+            SharedSmartMap map(name);
+            _exit(map.find<int>(99) != nullptr && *map.find<int>(99) == 99 ? 0 : 1);
+        }
+        int status_28 = -1;
+        waitpid(pid, &status_28, 0);
+        assert(WIFEXITED(status_28) && WEXITSTATUS(status_28) == 0);
+
+        *c27.getPointer<int>(50) = 500;
+        [[maybe_unused]] bool erased_27 = c27.erase<int>(60);
+        assert(erased_27);
+        *c27.getPointer<int>(1000) = 1000; // reuses the slot of key 60
+        [[maybe_unused]] auto version_27_2 = SharedSmartMap::publish(c27, name);
+        assert(version_27_2 == 2);
+        assert(*ptr_28_1 == 50 && *ptr_28_2 == 60);
+        [[maybe_unused]] bool refreshed_28_1 = c28.refresh();
+        [[maybe_unused]] bool refreshed_28_2 = c28.refresh();
+        assert(refreshed_28_1 && !refreshed_28_2 && c28.version() == 2);
+        assert(*ptr_28_1 == 500 && !ptr_28_2.isValid() && *c28.find<int>(1000) == 1000);
+
+        SharedSmartMap::unlink(name);
+        assert(*ptr_28_1 == 500);
+        [[maybe_unused]] bool thrown_28 = false;
+        try {
+            SharedSmartMap map(name);
+        }
+        catch (const std::runtime_error&) {
+            thrown_28 = true;
+        }
+        assert(thrown_28);
+    }
+
+    // Test StaticSmartMap: same semantics as SmartMap for a fixed set of types
+    {
+        using Map = StaticSmartMap<int, std::string, ChunkedInt>;
+        Map* c29 = new Map;
+        auto ptr_29_1 = c29->getPointer<int>(1);
+        auto ptr_29_2 = c29->getPointer<std::string>("paavo");
+        *ptr_29_1 = 29;
+        *ptr_29_2 = "koira";
+        for (int i=0; i<1000; ++i) {
+            *c29->getPointer<int>(i+2) = i;
+            (*c29->getPointer<ChunkedInt>(i)).value = i;
+        }
+        assert(*ptr_29_1 == 29 && *ptr_29_2 == "koira");
+        assert(*c29->find<int>(501) == 499 && c29->find<int>(5000) == nullptr);
+        assert(*c29->find<std::string>("paavo") == "koira" && c29->find<std::string>("kissa") == nullptr);
+
+        auto ptr_29_3 = ptr_29_1;
+        auto ptr_29_4 = std::move(ptr_29_3);
+        assert(!ptr_29_3.isValid() && ptr_29_4.isValid() && *ptr_29_4 == 29);
+
+        Map c30 = *c29;
+        *c30.getPointer<int>(1) = 30;
+        assert(*ptr_29_1 == 29 && *c30.find<int>(1) == 30 && *c30.find<std::string>("paavo") == "koira");
+
+        Map c31 = std::move(*c29);
+        delete c29;
+        assert(ptr_29_1.isValid() && *ptr_29_1 == 29 && *c31.find<int>(1) == 29);
+        [[maybe_unused]] bool erased_31_1 = c31.erase<int>(1);
+        [[maybe_unused]] bool erased_31_2 = c31.erase<int>(1);
+        assert(erased_31_1 && !erased_31_2);
+        assert(!ptr_29_1.isValid() && ptr_29_2.isValid());
+
+        int sum_31 = 0;
+        c31.forEach<ChunkedInt>([&](ChunkedInt& o) { sum_31 += o.value; });
+        assert(sum_31 == 999*1000/2);
+
+        c30 = c31;
+        assert(c30.find<int>(1) == nullptr && *c30.find<int>(2) == 0);
+        c31 = Map();
+        assert(!ptr_29_2.isValid() && c31.find<int>(2) == nullptr);
+    }
+
+    // Test that Pointers survive chains of moves and get invalidated by the final owner
+    {
+        auto* c32 = new SmartMap;
+        auto ptr_32_1 = c32->getPointer<int>(32);
+        *ptr_32_1 = 32;
+        SmartMap c33 = std::move(*c32);
+        delete c32;
+        SmartMap c34;
+        c34 = std::move(c33);
+        auto ptr_32_2 = ptr_32_1;
+        assert(ptr_32_2.isValid() && *c34.find<int>(32) == 32);
+        c34 = SmartMap();
+        assert(!ptr_32_1.isValid() && !ptr_32_2.isValid());
+    }
+
+    // Test lazy Pointer rebinding: Pointers resolve the objects after reallocation on dereference
+    {
+        SmartMap c36;
+        auto ptr_36_1 = c36.getPointer<LazyInt>(1);
+        (*ptr_36_1).value = 36;
+        auto ptr_36_2 = ptr_36_1;
+        for (int i=2; i<1000; ++i)
+            (*c36.getPointer<LazyInt>(i)).value = i;
+        [[maybe_unused]] SmartMap::PointerView<LazyInt> view_36_1 = ptr_36_2;
+        assert(&*view_36_1 == c36.find<LazyInt>(1) && (*view_36_1).value == 36);
+        assert(ptr_36_1.isValid() && &*ptr_36_1 == c36.find<LazyInt>(1) && (*ptr_36_1).value == 36);
+        c36.reserve<LazyInt>(100000);
+        auto ptr_36_3 = std::move(ptr_36_2);
+        assert((*ptr_36_3).value == 36 && &*ptr_36_3 == c36.find<LazyInt>(1));
+        [[maybe_unused]] bool erased_36 = c36.erase<LazyInt>(1);
+        assert(erased_36 && !ptr_36_1.isValid() && !ptr_36_3.isValid());
+    }
+
+    // Test statistics
+    {
+        SmartMap c37;
+        for (int i=0; i<1000; ++i)
+            *c37.getPointer<int>(i) = i;
+        auto ptr_37_1 = c37.getPointer<int>("paavo");
+        auto ptr_37_2 = c37.getPointer<double>(1);
+        [[maybe_unused]] bool erased_37 = c37.erase<int>(0);
+        assert(erased_37);
+        auto stats_37 = c37.stats();
+        assert(stats_37.size() == 2);
+        [[maybe_unused]] auto& s_37 = stats_37[0].typeId == SmartMap::getTypeId<int>() ? stats_37[0] : stats_37[1];
+        assert(s_37.typeName == "int" && s_37.objects == 1000 && s_37.slots == 1001 && s_37.capacity >= 1001);
+        assert(s_37.bytes >= 1001*sizeof(int) && s_37.pointers == 1 && s_37.keys == 1000);
+        assert(s_37.maxLoadFactor > 0.0f && s_37.maxLoadFactor <= 1.0f);
+#ifndef SMARTMAP_DISABLE_STATS
+        assert(s_37.invalidations > 0);
+#endif
+    }
+
+    // Test batched lookup
+    {
+        SmartMap c38;
+        std::vector<int> keys_38;
+        std::vector<std::string> sKeys_38;
+        for (int i=0; i<100; ++i) {
+            keys_38.push_back(i*3);
+            sKeys_38.push_back("key " + std::to_string(i*3));
+            if (i % 2 == 0) {
+                *c38.getPointer<int>(i*3) = i;
+                *c38.getPointer<int>(sKeys_38.back()) = -i;
+            }
+        }
+        std::vector<const int*> out_38(keys_38.size());
+        c38.lookup<int, int>(keys_38, out_38);
+        for (std::size_t i=0; i<keys_38.size(); ++i)
+            assert(out_38[i] == c38.find<int>(keys_38[i]) && (i % 2 == 1 || *out_38[i] == (int)i));
+        c38.lookup<int, std::string>(sKeys_38, out_38);
+        for (std::size_t i=0; i<keys_38.size(); ++i)
+            assert(out_38[i] == c38.find<int>(sKeys_38[i]) && (i % 2 == 1 || *out_38[i] == -(int)i));
+        std::vector<std::string_view> svKeys_38(sKeys_38.begin(), sKeys_38.end());
+        std::vector<const int*> svOut_38(keys_38.size());
+        c38.lookup<int>(svKeys_38, svOut_38);
+        assert(svOut_38 == out_38);
+
+        // Mutable lookup detaches the storage shared with a snapshot
+        SmartMap c39 = c38.snapshot();
+        std::vector<int*> out_39(keys_38.size());
+        c39.lookup<int, int>(keys_38, out_39);
+        *out_39[0] = 39;
+        assert(*c39.find<int>(0) == 39 && *c38.find<int>(0) == 0);
+        c39.lookup<int>(svKeys_38, out_39);
+        assert(out_39[2] == c39.find<int>(sKeys_38[2]) && *out_39[2] == -2);
+        std::vector<double*> out_39_2(2);
+        c39.lookup<double, int>(std::span<const int>(keys_38).first(2), out_39_2);
+        assert(out_39_2[0] == nullptr && out_39_2[1] == nullptr);
+    }
+
+    // Test deep copies of trivially copyable objects, including partially filled chunks and erased slots
+    {
+        SmartMap c40;
+        for (int i=0; i<103; ++i) {
+            (*c40.getPointer<ChunkedInt>(i)).value = i;
+            *c40.getPointer<int>(i) = -i;
+        }
+        [[maybe_unused]] bool erased_40 = c40.erase<ChunkedInt>(50) && c40.erase<int>(50);
+        assert(erased_40);
+        auto ptr_40 = c40.getPointer<ChunkedInt>(1);
+        SmartMap c41 = c40;
+        (*c41.getPointer<ChunkedInt>(1)).value = 41;
+        *c41.getPointer<int>(1) = 41;
+        assert((*ptr_40).value == 1 && *c40.find<int>(1) == -1);
+        for (int i=2; i<103; ++i) {
+            if (i == 50) {
+                assert(c41.find<ChunkedInt>(i) == nullptr && c41.find<int>(i) == nullptr);
+                continue;
+            }
+            assert(c41.find<ChunkedInt>(i)->value == i && *c41.find<int>(i) == -i);
+        }
+        *c41.getPointer<ChunkedInt>(1000) = ChunkedInt{1000};
+        assert(c41.find<ChunkedInt>(1000)->value == 1000 && c41.find<ChunkedInt>(102)->value == 102);
+    }
+
+    // Test that Pointers unregistered from the middle of the pointer list keep the rest updated
+    {
+        SmartMap c35;
+        std::vector<SmartMap::Pointer<int>> ptrs_35;
+        for (int i=0; i<100; ++i) {
+            ptrs_35.push_back(c35.getPointer<int>(i));
+            *ptrs_35.back() = i;
+        }
+        for (int i=98; i>=0; i-=2)
+            ptrs_35.erase(ptrs_35.begin() + i);
+        for (int i=100; i<10000; ++i)
+            *c35.getPointer<int>(i) = i;
+        for (std::size_t i=0; i<ptrs_35.size(); ++i)
+            assert(ptrs_35[i].isValid() && *ptrs_35[i] == (int)(2*i+1) && &*ptrs_35[i] == c35.find<int>((int)(2*i+1)));
+    }
+
+    // Test stable type ids: ids are known at compile time and colliding ids are detected
+    static_assert(SmartMap::compilerTypeName<int>() == "int");
+    static_assert(SmartMap::compilerTypeName<ChunkedInt>() == "ChunkedInt");
+    static_assert(SmartMap::getStableTypeId<std::string>() == 0x2767bd747119cc57ull); // FNV-1a of "std::string"
+    static_assert(SmartMap::getStableTypeId<NotInt>() == SmartMap::getStableTypeId<int>());
+    SmartMap::getTypeId<int>();
+    [[maybe_unused]] bool thrown_26 = false;
+    try {
+        SmartMap::getTypeId<NotInt>();
+    }
+    catch (const std::logic_error&) {
+        thrown_26 = true;
+    }
+    assert(thrown_26);
+
+    // Test concurrent access: threads insert overlapping key ranges and increment
+    // the objects through Pointers, each key is shared by two threads. The map
+    // doesn't guard the objects, so the increments are atomic.
+    ConcurrentSmartMap c10(4);
+    {
+        std::vector<std::thread> threads;
+        for (int t=0; t<4; ++t) {
+            threads.emplace_back([&c10, t]() {
+                for (int i=0; i<1000; ++i) {
+                    auto p = c10.getPointer<ChunkedInt>(t/2*1000 + i);
+                    auto q = p;
+                    std::atomic_ref<int>((*q).value).fetch_add(i, std::memory_order_relaxed);
+                }
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+    }
+    for (int i=0; i<2000; ++i)
+        assert((*c10.getPointer<ChunkedInt>(i)).value == 2*(i%1000));
+    (*c10.getPointer<ChunkedInt>(GridKey{ 1, 2 })).value = 12;
+    assert((*c10.getPointer<ChunkedInt>(GridKey{ 1, 2 })).value == 12);
+    assert((*c10.getPointer<ChunkedInt>(GridKey{ 2, 1 })).value == 0);
+
     return 0;
 }
 
 int main()
 {
-    return test();
+    return testFlatHashMap() + test();
 }